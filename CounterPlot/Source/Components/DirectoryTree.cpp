@@ -11,38 +11,23 @@ public:
 
 
     //=========================================================================
-    class ElementComparator
+    Item (DirectoryTree& directory, File file, bool isDirectory) : directory (directory), file (file), isDirectory (isDirectory)
     {
-    public:
-        static int compareElements (File& f1, File& f2)
-        {
-            return DefaultElementComparator<String>::compareElements (f1.getFileName(), f2.getFileName());
-        }
-    };
-
+        setDrawsInLeftMargin (true);
+        refreshLook (false);
+    }
 
-    //=========================================================================
-    Item (DirectoryTree& directory, File file) : directory (directory), file (file)
+    /** Creates a placeholder row, shown while a directory is being scanned. */
+    Item (DirectoryTree& directory) : directory (directory), isPlaceholder (true)
     {
-        isDirectory = file.isDirectory();
         setDrawsInLeftMargin (true);
         refreshLook (false);
     }
 
     void refreshLook (bool recursively)
     {
-        Font font;
-
-        if (auto tree = getOwnerView())
-            if (auto laf = dynamic_cast<AppLookAndFeel*> (&tree->getLookAndFeel()))
-                font = laf->getDefaultFont();
-
-        auto text = file.getFileName();
-        itemHeight = font.getHeight() * 11 / 5;
-
-        glyphs.clear();
-        glyphs.addLineOfText (font, text, 0, 0);
-        glyphs.justifyGlyphs (0, text.length(), 0, 0, 1e10, itemHeight, Justification::centredLeft);
+        itemHeight = getFont().getHeight() * 11 / 5;
+        glyphsNeedUpdate = true;
 
         if (recursively)
             for (int n = 0; n < getNumSubItems(); ++n)
@@ -51,11 +36,26 @@ public:
 
     void paintItem (Graphics& g, int width, int height) override
     {
+        // Glyphs are laid out when an item is first painted, rather than when
+        // it is made, since a large directory has many more items than rows.
+        // --------------------------------------------------------------------
+        if (glyphsNeedUpdate)
+        {
+            auto font = getFont();
+            auto text = isPlaceholder ? String ("Scanning...") : file.getFileName();
+
+            glyphs.clear();
+            glyphs.addLineOfText (font, text, 0, 0);
+            glyphs.justifyGlyphs (0, text.length(), 0, 0, 1e10, itemHeight, Justification::centredLeft);
+            glyphsNeedUpdate = false;
+        }
+
         Colour textColour;
 
-        if (file.isDirectory())    textColour = getOwnerView()->findColour (AppLookAndFeel::directoryTreeDirectory);
+        if (isDirectory)           textColour = getOwnerView()->findColour (AppLookAndFeel::directoryTreeDirectory);
         if (file.existsAsFile())   textColour = getOwnerView()->findColour (AppLookAndFeel::directoryTreeFile);
         if (file.isSymbolicLink()) textColour = getOwnerView()->findColour (AppLookAndFeel::directoryTreeSymbolicLink);
+        if (isPlaceholder)         textColour = getOwnerView()->findColour (AppLookAndFeel::directoryTreeFile).withMultipliedAlpha (0.5f);
 
         g.setColour (isMouseOver() ? textColour.brighter (0.8f) : textColour);
         glyphs.draw (g);
@@ -68,7 +68,7 @@ public:
 
     bool canBeSelected() const override
     {
-        return true;
+        return ! isPlaceholder;
     }
 
     int getItemHeight() const override
@@ -78,12 +78,12 @@ public:
 
     String getUniqueName() const override
     {
-        return file.getFullPathName();
+        return isPlaceholder ? String ("<scanning>") : file.getFullPathName();
     }
 
     void itemSelectionChanged (bool isNowSelected) override
     {
-        if (isNowSelected)
+        if (isNowSelected && ! directory.refreshing)
         {
             directory.sendSelectedFilesChanged();
         }
@@ -93,27 +93,117 @@ public:
     {
         if (isNowOpen)
         {
-            auto dirs = file.findChildFiles (File::findDirectories, false);
-            dirs.sort (comparator);
-
-            auto files = file.findChildFiles (File::findFiles, false);
-            files.sort (comparator);
+            auto entries = Array<DirectoryListingCache::Entry>();
 
-            for (auto child : dirs)
-                if (! child.isHidden())
-                    addSubItem (new Item (directory, child));
-
-            for (auto child : files)
-                if (! child.isHidden())
-                    addSubItem (new Item (directory, child));
+            if (directory.listings->getListing (file, entries))
+            {
+                setChildItems (entries);
+            }
+            else
+            {
+                addSubItem (new Item (directory));
+                isScanning = true;
+                directory.listings->requestListing (file);
+            }
         }
         else
         {
             directory.setMouseOverItem (nullptr);
             clearSubItems();
+            isScanning = false;
+            pendingOpenness = nullptr;
+        }
+    }
+
+    void addChildItems (const Array<DirectoryListingCache::Entry>& entries)
+    {
+        for (const auto& entry : entries)
+            addSubItem (new Item (directory, entry.file, entry.isDirectory));
+    }
+
+    void setChildItems (const Array<DirectoryListingCache::Entry>& entries)
+    {
+        // Items that are already there (made from the batches of a scan, or
+        // before a rescan) are kept, along with their openness and selection;
+        // only entries that are new get an item. The listing was sorted on
+        // the scanning thread, so the kept items are detached and the rows
+        // re-added in listing order, rather than sorted again here. Openness
+        // still waiting to be restored from before a scan is applied last.
+        // --------------------------------------------------------------------
+        auto wanted = std::map<String, bool>();
+        auto kept = std::map<String, Item*>();
+
+        for (const auto& entry : entries)
+            wanted[entry.file.getFullPathName()] = entry.isDirectory;
+
+        directory.setMouseOverItem (nullptr);
+
+        for (int n = getNumSubItems() - 1; n >= 0; --n)
+        {
+            auto item = dynamic_cast<Item*> (getSubItem (n));
+            auto entry = wanted.find (item->file.getFullPathName());
+
+            if (item->isPlaceholder || entry == wanted.end() || entry->second != item->isDirectory)
+            {
+                removeSubItem (n);
+            }
+            else
+            {
+                removeSubItem (n, false);
+                kept[entry->first] = item;
+            }
+        }
+
+        for (const auto& entry : entries)
+        {
+            auto item = kept.find (entry.file.getFullPathName());
+
+            if (item != kept.end())
+                addSubItem (item->second);
+            else
+                addSubItem (new Item (directory, entry.file, entry.isDirectory));
+        }
+        isScanning = false;
+
+        if (pendingOpenness)
+        {
+            auto state = std::move (pendingOpenness);
+            applyOpenness (*state);
+        }
+    }
+
+    void applyOpenness (const XmlElement& state)
+    {
+        // Sub-items that are opened here, but whose listing is still being
+        // scanned, keep their part of the state to restore when it arrives.
+        // --------------------------------------------------------------------
+        restoreOpennessState (state);
+
+        forEachXmlChildElementWithTagName (state, child, "OPEN")
+        {
+            for (int n = 0; n < getNumSubItems(); ++n)
+            {
+                auto item = dynamic_cast<Item*> (getSubItem (n));
+
+                if (item->isScanning && item->getUniqueName() == child->getStringAttribute ("id"))
+                    item->pendingOpenness = std::make_unique<XmlElement> (*child);
+            }
         }
     }
 
+    Item* findOpenItemForDirectory (const File& target)
+    {
+        if (file == target)
+            return isOpen() ? this : nullptr;
+
+        for (int n = 0; n < getNumSubItems(); ++n)
+            if (auto item = dynamic_cast<Item*> (getSubItem (n)))
+                if (! item->isPlaceholder && (target.isAChildOf (item->file) || target == item->file))
+                    return item->findOpenItemForDirectory (target);
+
+        return nullptr;
+    }
+
     void itemClicked (const MouseEvent& e) override
     {
         if (e.mods.isPopupMenu())
@@ -133,13 +223,24 @@ private:
         return directory.mouseOverItem == this;
     }
 
+    Font getFont() const
+    {
+        if (auto tree = getOwnerView())
+            if (auto laf = dynamic_cast<AppLookAndFeel*> (&tree->getLookAndFeel()))
+                return laf->getDefaultFont();
+        return Font();
+    }
+
     friend class DirectoryTree;
     int itemHeight = 24;
     GlyphArrangement glyphs;
+    bool glyphsNeedUpdate = true;
     DirectoryTree& directory;
     File file;
     bool isDirectory = false; // cache for performance
-    ElementComparator comparator;
+    bool isPlaceholder = false;
+    bool isScanning = false;
+    std::unique_ptr<XmlElement> pendingOpenness;
 };
 
 
@@ -155,11 +256,13 @@ DirectoryTree::DirectoryTree()
     tree.getViewport()->setWantsKeyboardFocus (false);
     setColours();
     addAndMakeVisible (tree);
+    listings->addListener (this);
 }
 
 DirectoryTree::~DirectoryTree()
 {
     tree.setRootItem (nullptr);
+    listings->removeListener (this);
 }
 
 void DirectoryTree::addListener (Listener* listener)
@@ -187,11 +290,11 @@ void DirectoryTree::reloadAll()
 
     setMouseOverItem (nullptr);
     tree.setRootItem (nullptr);
-    root = std::make_unique<Item> (*this, currentDirectory);
+    root = std::make_unique<Item> (*this, currentDirectory, currentDirectory.isDirectory());
     tree.setRootItem (root.get());
 
     if (state)
-        root->restoreOpennessState (*state);
+        root->applyOpenness (*state);
     else
         root->setOpen (true);
 }
@@ -208,7 +311,7 @@ std::unique_ptr<XmlElement> DirectoryTree::getRootOpennessState() const
 
 void DirectoryTree::restoreRootOpenness (const XmlElement& state)
 {
-    root->restoreOpennessState (state);
+    root->applyOpenness (state);
 }
 
 
@@ -285,6 +388,38 @@ void DirectoryTree::handleAsyncUpdate()
 
 
 
+//=============================================================================
+void DirectoryTree::directoryListingBatchFound (const File& directory, const Array<DirectoryListingCache::Entry>& entries)
+{
+    if (auto item = root ? root->findOpenItemForDirectory (directory) : nullptr)
+        if (item->isScanning)
+            item->addChildItems (entries);
+}
+
+void DirectoryTree::directoryListingCompleted (const File& directory, const Array<DirectoryListingCache::Entry>& entries)
+{
+    // The open directory's items are brought in line with the listing; any
+    // openness restored on the way does not notify listeners of a selection
+    // change.
+    // ------------------------------------------------------------------------
+    if (auto item = root ? root->findOpenItemForDirectory (directory) : nullptr)
+    {
+        refreshing = true;
+        item->setChildItems (entries);
+        refreshing = false;
+    }
+}
+
+void DirectoryTree::directoryListingChanged (const File& directory)
+{
+    // The items of an open directory are kept until its new listing arrives.
+    if (root && root->findOpenItemForDirectory (directory))
+        listings->requestListing (directory);
+}
+
+
+
+
 //=============================================================================
 void DirectoryTree::sendSelectedFilesAsSources()
 {
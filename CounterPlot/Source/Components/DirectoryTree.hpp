@@ -1,11 +1,15 @@
 #pragma once
 #include "JuceHeader.h"
+#include "../Core/DirectoryListingCache.hpp"
 
 
 
 
 //=============================================================================
-class DirectoryTree : public Component, public AsyncUpdater
+class DirectoryTree
+: public Component
+, public AsyncUpdater
+, private DirectoryListingCache::Listener
 {
 public:
     class Listener
@@ -42,15 +46,20 @@ public:
 
 private:
     //=========================================================================
+    void directoryListingBatchFound (const File& directory, const Array<DirectoryListingCache::Entry>& entries) override;
+    void directoryListingCompleted (const File& directory, const Array<DirectoryListingCache::Entry>& entries) override;
+    void directoryListingChanged (const File& directory) override;
     void sendSelectedFilesAsSources();
     void sendSelectedFilesChanged();
     void setMouseOverItem (TreeViewItem*);
     void setColours();
     class Item;
     friend class Item;
+    SharedResourcePointer<DirectoryListingCache> listings;
     TreeView tree;
     std::unique_ptr<Item> root;
     TreeViewItem* mouseOverItem = nullptr;
     File currentDirectory;
     ListenerList<Listener> listeners;
+    bool refreshing = false;
 };
@@ -820,6 +820,12 @@ void EnvironmentView::setKernel (const Runtime::Kernel* kernelToView)
     refresh();
 }
 
+void EnvironmentView::setStatistics (const StringPairArray& statisticsToView)
+{
+    statistics = statisticsToView;
+    refresh();
+}
+
 void EnvironmentView::refresh()
 {
     keys.clear();
@@ -870,13 +876,23 @@ void EnvironmentView::setColours()
 //=============================================================================
 int EnvironmentView::getNumRows()
 {
-    return keys.size();
+    return keys.size() + statistics.size();
 }
 
 void EnvironmentView::paintListBoxItem (int rowNumber, Graphics &g, int width, int height, bool rowIsSelected)
 {
     g.fillAll (rowIsSelected ? findColour (ListBox::backgroundColourId).darker() : Colours::transparentBlack);
 
+    if (rowNumber >= keys.size())
+    {
+        auto index = rowNumber - keys.size();
+        g.setFont (Font ("Menlo", 11, Font::italic));
+        g.setColour (findColour (AppLookAndFeel::environmentViewText2));
+        g.drawText (statistics.getAllKeys()[index], 8, 0, width - 16, height, Justification::centredLeft);
+        g.drawText (statistics.getAllValues()[index], 8, 0, width - 16, height, Justification::centredRight);
+        return;
+    }
+
     auto key = keys[rowNumber];
     auto err = kernel->error_at (key.toStdString());
     auto repr = Runtime::represent (kernel->at (keys[rowNumber].toStdString()));
@@ -903,6 +919,9 @@ void EnvironmentView::paintListBoxItem (int rowNumber, Graphics &g, int width, i
 
 void EnvironmentView::selectedRowsChanged (int lastRowSelected)
 {
+    if (lastRowSelected >= keys.size())
+        return;
+
     if (auto main = findParentComponentOfClass<MainComponent>())
     {
         main->showKernelRule (keys[lastRowSelected]);
@@ -911,6 +930,9 @@ void EnvironmentView::selectedRowsChanged (int lastRowSelected)
 
 String EnvironmentView::getTooltipForRow (int row)
 {
+    if (row >= keys.size())
+        return String();
+
     auto key = keys[row];
     auto err = kernel->error_at (key.toStdString());
     return err;
@@ -1056,7 +1078,8 @@ void KernelRuleEntry::setColours()
 //=============================================================================
 MainComponent::MainComponent()
 {
-    filePoller.setCallback ([this] (File) { reloadCurrentFile(); });
+    reloadTimer.setCallback ([this] (File file) { if (file == currentFile) reloadCurrentFile(); });
+    hdf5Index->addListener (this);
     directoryTree.addListener (this);
     directoryTree.getTreeView().setWantsKeyboardFocus (directoryTreeShowing);
     sourceList.addListener (this);
@@ -1093,6 +1116,8 @@ MainComponent::MainComponent()
 
 MainComponent::~MainComponent()
 {
+    fileNotifications->unsubscribeAll (this);
+    hdf5Index->removeListener (this);
 }
 
 void MainComponent::setCurrentDirectory (File newCurrentDirectory)
@@ -1102,8 +1127,7 @@ void MainComponent::setCurrentDirectory (File newCurrentDirectory)
 
 void MainComponent::setCurrentFile (File newCurrentFile)
 {
-    currentFile = newCurrentFile;
-    filePoller.setFileToPoll (currentFile);
+    watchCurrentFile (newCurrentFile);
 
     if (currentViewer && currentViewer->isInterestedInFile (currentFile))
         currentViewer->loadFile (currentFile);
@@ -1252,11 +1276,13 @@ void MainComponent::makeViewerCurrent (Viewer* viewer)
             viewer->loadFile (currentFile);
             statusBar.setCurrentViewerName (viewer->getViewerName());
             environmentView.setKernel (viewer->getKernel());
+            environmentView.setStatistics (viewer->getStatistics());
         }
         else
         {
             statusBar.setCurrentViewerName ("Viewer List");
             environmentView.setKernel (nullptr);
+            environmentView.setStatistics (StringPairArray());
         }
         if (isKernelRuleEntryShowing() && (! viewer || ! viewer->canReceiveMessages()))
         {
@@ -1288,6 +1314,16 @@ void MainComponent::loadControlsForViewer (Viewer* viewer)
     }
 }
 
+void MainComponent::watchCurrentFile (File newCurrentFile)
+{
+    fileNotifications->unsubscribe (this, currentFile);
+    reloadTimer.cancel();
+    currentFile = newCurrentFile;
+
+    if (currentFile.exists())
+        fileNotifications->subscribe (this, currentFile);
+}
+
 void MainComponent::refreshCurrentViewerName()
 {
     if (currentViewer)
@@ -1393,8 +1429,7 @@ void MainComponent::directoryTreeWantsFileToBeSource (DirectoryTree*, File file)
 //=============================================================================
 void MainComponent::sourceListSelectedSourceChanged (SourceList*, File file)
 {
-    currentFile = file;
-    filePoller.setFileToPoll (currentFile);
+    watchCurrentFile (file);
 
     if (currentViewer && currentViewer->isInterestedInFile (currentFile))
         currentViewer->loadFile (currentFile);
@@ -1467,7 +1502,7 @@ void MainComponent::viewerEnvironmentChanged()
 {
     if (currentViewer)
     {
-        environmentView.refresh();
+        environmentView.setStatistics (currentViewer->getStatistics());
         kernelRuleEntry.refresh (currentViewer->getKernel());
     }
 }
@@ -1509,6 +1544,33 @@ void MainComponent::viewerCollectionViewerRemoved (Viewer *viewer)
 
 
 
+//=============================================================================
+void MainComponent::fileNotificationServiceFilesChanged (const Array<File>& changedFiles)
+{
+    // The reload waits for the file to settle, so a file that is still being
+    // written is not loaded half-finished.
+    if (changedFiles.contains (currentFile) || currentFile.isDirectory())
+        reloadTimer.fileChanged (currentFile);
+}
+
+void MainComponent::hdf5MetadataIndexChanged (const Array<File>& files)
+{
+    // Viewers that filter on HDF5 contents turn down a file until it has been
+    // probed, so a less specific viewer may have been chosen meanwhile. Once
+    // the file is probed, the viewer is looked for again and switched to if
+    // it differs.
+    if (files.contains (currentFile))
+    {
+        auto viewer = viewers.findViewerForFile (currentFile);
+
+        if (viewer != nullptr || ! isViewerSuitable (currentViewer))
+            makeViewerCurrent (viewer);
+    }
+}
+
+
+
+
 //=============================================================================
 void MainComponent::layout (bool animated)
 {
@@ -9,6 +9,8 @@
 #include "../Core/Runtime.hpp"
 #include "../Core/TaskPool.hpp"
 #include "../Core/DataHelpers.hpp"
+#include "../Core/FileNotificationService.hpp"
+#include "../Core/HDF5MetadataIndex.hpp"
 #include "../Core/EditorKeyMappings.hpp"
 #include "../Plotting/ResizerFrame.hpp"
 
@@ -231,6 +233,7 @@ public:
     //=========================================================================
     EnvironmentView();
     void setKernel (const Runtime::Kernel* kernelToView);
+    void setStatistics (const StringPairArray& statisticsToView);
     void refresh();
     ListBox& getListBox() { return list; }
 
@@ -253,6 +256,7 @@ private:
     ListBox list;
     const Runtime::Kernel* kernel = nullptr;
     Array<String> keys;
+    StringPairArray statistics;
 };
 
 
@@ -302,6 +306,8 @@ class MainComponent
 , public FigureView::MessageSink
 , public Viewer::MessageSink
 , public ViewerCollection::Listener
+, public FileNotificationService::Listener
+, public HDF5MetadataIndex::Listener
 {
 public:
 
@@ -363,11 +369,18 @@ public:
     void viewerCollectionViewerAdded (Viewer*) override;
     void viewerCollectionViewerRemoved (Viewer*) override;
 
+    //=========================================================================
+    void fileNotificationServiceFilesChanged (const Array<File>& changedFiles) override;
+
+    //=========================================================================
+    void hdf5MetadataIndexChanged (const Array<File>& files) override;
+
 private:
     //=========================================================================
     void layout (bool animated);
     void makeViewerCurrent (Viewer* viewer);
     void loadControlsForViewer (Viewer* viewer);
+    void watchCurrentFile (File newCurrentFile);
 
     //=========================================================================
     File currentFile;
@@ -386,5 +399,7 @@ private:
     KernelRuleEntry kernelRuleEntry;
     UserExtensionsDirectoryEditor userExtensionsDirectoryEditor;
     EitherOrComponent sidebar;
-    FilePoller filePoller;
+    SharedResourcePointer<FileNotificationService> fileNotifications;
+    SharedResourcePointer<HDF5MetadataIndex> hdf5Index;
+    FileSettleTimer reloadTimer;
 };
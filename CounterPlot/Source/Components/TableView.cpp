@@ -69,6 +69,12 @@ TableModel TableModel::fromVar (const var& value)
             model.add (item.name.toString(), DataHelpers::ndarrayDouble1FromVar (item.value));
         else if (auto data = Runtime::opt_data<nd::array<double, 1>> (item.value))
             model.add (item.name.toString(), *data);
+        else if (auto data = Runtime::opt_data<nd::array<float, 1>> (item.value))
+        {
+            auto widened = nd::array<double, 1> (data->size());
+            std::copy (data->begin(), data->end(), widened.begin());
+            model.add (item.name.toString(), widened);
+        }
 
     model.scrollPosition.x = 0.f;
     model.scrollPosition.y = value["scroll-position"];
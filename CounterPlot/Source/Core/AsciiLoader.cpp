@@ -1,63 +1,191 @@
-#include <sstream>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include "AsciiLoader.hpp"
 
 
 
 
 // =============================================================================
-AsciiLoader::AsciiLoader (std::istream& stream)
+static bool isBlank (char c)
 {
-    int fileLine = 0;
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static bool isSeparator (char c)
+{
+    return isBlank (c) || c == '\n';
+}
+
+static const char* findEndOfLine (const char* p, const char* end)
+{
+    auto eol = static_cast<const char*> (std::memchr (p, '\n', end - p));
+    return eol ? eol : end;
+}
 
-    while (stream)
+static bool isDataLine (const char* p, const char* eol)
+{
+    if (p == eol || *p == '#')
+    {
+        return false;
+    }
+    while (p < eol && isBlank (*p))
     {
-        std::string line;
-        std::getline (stream, line);
-        std::istringstream iss (line);
-        fileLine += 1;
+        ++p;
+    }
+    return p < eol;
+}
 
-        if (line[0] == '#' && data.empty())
-        {
-            /*
-            * The first line is header information.
-            */
-            names = std::vector<std::string> {
-                std::istream_iterator<std::string>(iss),
-                std::istream_iterator<std::string>() };
+static int countWords (const char* p, const char* eol)
+{
+    int count = 0;
 
-            names.erase (names.begin());
-            numColumns = names.size();
-        }
-        else if (line[0] != '#')
-        {
-            std::vector<double> row {
-                std::istream_iterator<double>(iss),
-                std::istream_iterator<double>() };
+    while (p < eol)
+    {
+        while (p < eol && isBlank (*p)) ++p;
+        auto start = p;
+        while (p < eol && ! isBlank (*p)) ++p;
+        count += p > start;
+    }
+    return count;
+}
 
-            if (names.empty() && data.empty())
-            {
-                numColumns = row.size();
-            }
+static std::vector<std::string> splitWords (const char* p, const char* eol)
+{
+    std::vector<std::string> words;
+
+    while (p < eol)
+    {
+        while (p < eol && isBlank (*p)) ++p;
+        auto start = p;
+        while (p < eol && ! isBlank (*p)) ++p;
+
+        if (p > start)
+            words.emplace_back (start, p);
+    }
+    return words;
+}
+
+
+
+
+// =============================================================================
+AsciiLoader::AsciiLoader (const File& file, ParallelFor parallelFor)
+{
+    auto compression = detectCompression (file);
+
+    if (compression != Compression::none)
+    {
+        loadCompressed (file, compression);
+        return;
+    }
+
+    mapped = std::make_unique<MemoryMappedFile> (file, MemoryMappedFile::readOnly);
 
+    if (file.getSize() > 0 && mapped->getData() == nullptr)
+    {
+        status = "Could not open " + file.getFullPathName().toStdString();
+        return;
+    }
+
+    begin = static_cast<const char*> (mapped->getData());
+    end = begin + mapped->getSize();
+    source = file;
+    sourceModified = file.getLastModificationTime();
+    auto p = begin;
+    int headerLines = 0;
+
+
+    /*
+     * Lines before the first row of data are the header; a line beginning with
+     * '#' there gives the column names. If there's none, the number of columns
+     * is taken from the first row.
+     */
+    while (p < end)
+    {
+        auto eol = findEndOfLine (p, end);
+
+        if (isDataLine (p, eol))
+        {
             if (names.empty())
             {
+                numColumns = countWords (p, eol);
+
                 for (int i = 0; i < numColumns; ++i)
                 {
                     names.push_back ("Col " + std::to_string(i));
                 }
             }
+            break;
+        }
+        if (p < eol && *p == '#')
+        {
+            names = splitWords (p, eol);
+            names.erase (names.begin());
+            numColumns = names.size();
+        }
+        p = eol + (eol < end);
+        headerLines += 1;
+    }
 
-            if (row.size() == numColumns)
-            {
-                data.insert (data.end(), row.begin(), row.end());
-                numRows += 1;
-            }
-            else if (! row.empty())
-            {
-                status = "Missing data on line " + std::to_string (fileLine);
-            }
+
+    /*
+     * The rest of the file is split into chunks at line boundaries, and each
+     * chunk finds the offsets of its rows. The offsets are then gathered into
+     * one index.
+     */
+    int numChunks = parallelFor ? jlimit (1, 256, int ((end - p) >> 20)) : 1;
+    auto chunkBegin = p;
+    chunks.resize (numChunks);
+
+    for (int n = 0; n < numChunks; ++n)
+    {
+        auto chunkEnd = n == numChunks - 1 ? end : p + (end - p) * (n + 1) / numChunks;
+
+        if (chunkEnd < chunkBegin)
+            chunkEnd = chunkBegin;
+        else if (chunkEnd < end)
+            chunkEnd = findEndOfLine (chunkEnd, end);
+
+        if (chunkEnd < end)
+            chunkEnd += 1;
+
+        chunks[n].begin = chunkBegin;
+        chunks[n].end = chunkEnd;
+        chunkBegin = chunkEnd;
+    }
+
+    if (parallelFor)
+        parallelFor (numChunks, [this] (int n) { indexRows (chunks[n]); });
+    else
+        for (auto& chunk : chunks)
+            indexRows (chunk);
+
+    for (auto& chunk : chunks)
+    {
+        chunk.firstRow = numRows;
+        chunk.firstLine = headerLines;
+        chunk.numRows = chunk.rowOffsets.size();
+        numRows += chunk.numRows;
+        headerLines += chunk.numLines;
+        rowOffsets.insert (rowOffsets.end(), chunk.rowOffsets.begin(), chunk.rowOffsets.end());
+
+        if (chunk.badLine != 0 && status.empty())
+        {
+            status = "Missing data on line " + std::to_string (chunk.firstLine + chunk.badLine);
         }
-    };
+        chunk.rowOffsets = std::vector<uint64>();
+    }
+
+    for (int j = 0; j < numColumns; ++j)
+    {
+        columns.push_back (std::make_unique<Column>());
+    }
+    tail.assign (end - jmin (end - begin, ptrdiff_t (4096)), end);
 }
 
 unsigned long AsciiLoader::getNumColumns() const
@@ -70,24 +198,25 @@ unsigned long AsciiLoader::getNumRows() const
     return numRows;
 }
 
-std::vector<double> AsciiLoader::getColumnData (int j) const
+std::vector<double> AsciiLoader::getColumnData (int j)
 {
     std::vector<double> column;
+    auto data = getColumn (j);
 
     for (int i = 0; i < numRows; ++i)
     {
-        column.push_back (data[i * numColumns + j]);
+        column.push_back (data(i));
     }
     return column;
 }
 
-std::vector<double> AsciiLoader::getRowData (int i) const
+std::vector<double> AsciiLoader::getRowData (int i)
 {
     std::vector<double> row;
 
     for (int j = 0; j < numColumns; ++j)
     {
-        row.push_back (data[i * numColumns + j]);
+        row.push_back (getColumn (j)(i));
     }
     return row;
 }
@@ -101,3 +230,650 @@ std::string AsciiLoader::getStatusMessage() const
 {
     return status;
 }
+
+nd::array<double, 1> AsciiLoader::getColumn (int index)
+{
+    auto& column = *columns.at (index);
+    const ScopedLock sl (column.lock);
+
+    if (column.decoded)
+    {
+        return column.data;
+    }
+    column.data = decodeColumn<double> (index);
+    column.storage = column.data;
+    column.decoded = true;
+    return column.data;
+}
+
+nd::array<float, 1> AsciiLoader::getFloatColumn (int index)
+{
+    auto& column = *columns.at (index);
+    const ScopedLock sl (column.lock);
+
+    if (column.decoded)
+    {
+        return column.getFloatRows (numRows);
+    }
+    return decodeColumn<float> (index);
+}
+
+template <typename ValueType>
+nd::array<ValueType, 1> AsciiLoader::decodeColumn (int index)
+{
+    /*
+     * The rows are read from the mapping made when the file was indexed. If
+     * the file has since been rewritten the offsets would point at the wrong
+     * text, and if it has been truncated, past the end of the pages that are
+     * still backed, so it is checked first.
+     */
+    if (source.getSize() != end - begin || source.getLastModificationTime() != sourceModified)
+    {
+        throw std::runtime_error ("The file " + source.getFileName().toStdString() + " changed after it was loaded");
+    }
+
+
+    /*
+     * Each row is known to have numColumns entries, so the entry is found by
+     * skipping index entries from the start of the row.
+     */
+    auto data = nd::array<ValueType, 1> (int (numRows));
+    auto x = 0.0;
+
+    for (unsigned long i = 0; i < numRows; ++i)
+    {
+        auto q = begin + rowOffsets[i];
+
+        for (int j = 0; j < index; ++j)
+        {
+            while (q < end && isBlank (*q)) ++q;
+            while (q < end && ! isSeparator (*q)) ++q;
+        }
+        while (q < end && isBlank (*q)) ++q;
+
+        if (! parseNumber (q, end, x))
+        {
+            throw std::runtime_error ("Bad number in column " + std::to_string (index + 1)
+                                      + " on line " + std::to_string (findLineNumber (i)));
+        }
+        data (int (i)) = ValueType (x);
+    }
+    return data;
+}
+
+void AsciiLoader::loadAllColumns (ParallelFor parallelFor)
+{
+    if (streamed)
+    {
+        return;
+    }
+
+    for (auto& column : columns)
+    {
+        column->lock.enter();
+        column->clear();
+        column->storage = nd::array<double, 1> (int (numRows));
+    }
+
+    auto badLines = std::vector<int> (chunks.size());
+
+    if (parallelFor)
+        parallelFor (int (chunks.size()), [this, &badLines] (int n) { parseRows (chunks[n], badLines[n]); });
+    else
+        for (int n = 0; n < chunks.size(); ++n)
+            parseRows (chunks[n], badLines[n]);
+
+    for (auto& column : columns)
+    {
+        column->data = column->storage;
+        column->decoded = true;
+        column->lock.exit();
+    }
+
+    for (auto badLine : badLines)
+    {
+        if (badLine != 0 && status.empty())
+        {
+            status = "Bad number on line " + std::to_string (badLine);
+        }
+    }
+}
+
+bool AsciiLoader::appendNewRows (const File& file)
+{
+    if (streamed || begin == end || end[-1] != '\n' || numColumns == 0 || ! status.empty())
+    {
+        return false;
+    }
+
+
+    /*
+     * The file is taken to have only been appended to if it has not shrunk,
+     * and the last few kilobytes that were loaded before are unchanged.
+     */
+    auto oldSize = end - begin;
+    auto newMapped = std::make_unique<MemoryMappedFile> (file, MemoryMappedFile::readOnly);
+    auto newBegin = static_cast<const char*> (newMapped->getData());
+
+    if (newBegin == nullptr
+        || ptrdiff_t (newMapped->getSize()) < oldSize
+        || std::memcmp (newBegin + oldSize - tail.size(), tail.data(), tail.size()) != 0)
+    {
+        return false;
+    }
+
+    for (auto& column : columns)
+    {
+        column->lock.enter();
+    }
+
+    for (auto& chunk : chunks)
+    {
+        chunk.begin = newBegin + (chunk.begin - begin);
+        chunk.end = newBegin + (chunk.end - begin);
+    }
+
+    mapped = std::move (newMapped);
+    begin = newBegin;
+    end = begin + mapped->getSize();
+    sourceModified = file.getLastModificationTime();
+
+    auto chunk = Chunk();
+    chunk.begin = begin + oldSize;
+    chunk.end = end;
+    chunk.firstRow = numRows;
+    chunk.firstLine = chunks.empty() ? 0 : chunks.back().firstLine + chunks.back().numLines;
+    indexRows (chunk);
+    chunk.numRows = chunk.rowOffsets.size();
+    auto oldNumRows = numRows;
+    numRows += chunk.numRows;
+    rowOffsets.insert (rowOffsets.end(), chunk.rowOffsets.begin(), chunk.rowOffsets.end());
+    chunk.rowOffsets = std::vector<uint64>();
+
+    if (chunk.badLine != 0)
+    {
+        status = "Missing data on line " + std::to_string (chunk.firstLine + chunk.badLine);
+    }
+
+
+    /*
+     * If every column is decoded, the new rows are parsed into the end of its
+     * storage, which is grown geometrically so that a file being appended to
+     * a few rows at a time is not copied in full on every append. Otherwise
+     * the decoded columns are dropped, to be decoded again (in full) when
+     * next asked for.
+     */
+    auto allDecoded = std::all_of (columns.begin(), columns.end(), [] (const auto& column) { return column->decoded; });
+
+    for (auto& column : columns)
+    {
+        if (allDecoded)
+        {
+            column->reserveRows (oldNumRows, numRows);
+        }
+        else
+        {
+            column->clear();
+        }
+    }
+
+    if (allDecoded && status.empty())
+    {
+        auto badLine = 0;
+        parseRows (chunk, badLine);
+
+        if (badLine != 0)
+            status = "Bad number on line " + std::to_string (badLine);
+    }
+
+    if (allDecoded)
+    {
+        for (auto& column : columns)
+        {
+            column->data = column->getRows (numRows);
+        }
+    }
+
+    chunks.push_back (chunk);
+    tail.assign (end - jmin (end - begin, ptrdiff_t (4096)), end);
+
+    for (auto& column : columns)
+    {
+        column->lock.exit();
+    }
+    return true;
+}
+
+
+
+
+// =============================================================================
+void AsciiLoader::Column::reserveRows (unsigned long numUsed, unsigned long numRequired)
+{
+    auto capacity = (unsigned long) storage.shape(0);
+
+    if (numRequired <= capacity)
+    {
+        return;
+    }
+    auto grown = nd::array<double, 1> (int (jmax (numRequired, 2 * capacity, 1024ul)));
+    std::copy_n (storage.begin(), numUsed, grown.begin());
+    storage = grown;
+}
+
+nd::array<float, 1> AsciiLoader::Column::getFloatRows (unsigned long numRows)
+{
+    /*
+     * Rows already narrowed are not touched, so views of them handed out
+     * earlier stay valid; the storage is grown geometrically, like storage.
+     */
+    auto _ = nd::axis::all();
+    auto capacity = (unsigned long) floatStorage.shape(0);
+
+    if (numRows > capacity)
+    {
+        auto grown = nd::array<float, 1> (int (jmax (numRows, 2 * capacity, 1024ul)));
+        std::copy_n (floatStorage.begin(), numFloatRows, grown.begin());
+        floatStorage = grown;
+    }
+
+    for (auto i = numFloatRows; i < numRows; ++i)
+    {
+        floatStorage (int (i)) = float (data (int (i)));
+    }
+    numFloatRows = numRows;
+
+    if (numRows == (unsigned long) floatStorage.shape(0))
+    {
+        return floatStorage;
+    }
+    return floatStorage.select (_|0|int (numRows));
+}
+
+void AsciiLoader::Column::clear()
+{
+    data = nd::array<double, 1>();
+    storage = nd::array<double, 1>();
+    floatStorage = nd::array<float, 1>();
+    numFloatRows = 0;
+    decoded = false;
+}
+
+nd::array<double, 1> AsciiLoader::Column::getRows (unsigned long numRows) const
+{
+    auto _ = nd::axis::all();
+
+    if (numRows == (unsigned long) storage.shape(0))
+    {
+        return storage;
+    }
+    return storage.select (_|0|int (numRows));
+}
+
+
+
+
+// =============================================================================
+AsciiLoader::Compression AsciiLoader::detectCompression (const File& file)
+{
+    uint8 magic[4] = { 0, 0, 0, 0 };
+    FileInputStream stream (file);
+
+    if (stream.openedOk())
+        stream.read (magic, 4);
+
+    if (magic[0] == 0x1f && magic[1] == 0x8b)
+        return Compression::gzip;
+
+    if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+        return Compression::zstd;
+
+    return Compression::none;
+}
+
+void AsciiLoader::loadCompressed (const File& file, Compression compression)
+{
+    const int blockSize = 1 << 20;
+    const int maxQueuedBlocks = 4;
+
+    auto source = std::unique_ptr<InputStream>();
+    auto process = std::unique_ptr<ChildProcess>();
+    auto read = std::function<int(char*, int)>();
+
+    streamed = true;
+
+
+    /*
+     * gzip is decoded with JUCE's zlib. There is no zstd library in the build,
+     * so zstd files are piped through the zstd program, if it can be found.
+     */
+    if (compression == Compression::gzip)
+    {
+        source = std::make_unique<GZIPDecompressorInputStream> (new FileInputStream (file), true, GZIPDecompressorInputStream::gzipFormat);
+        read = [&source] (char* buffer, int size) { return source->read (buffer, size); };
+    }
+    else
+    {
+        process = std::make_unique<ChildProcess>();
+
+        if (! process->start (StringArray { "zstd", "-dcq", "--", file.getFullPathName() }, ChildProcess::wantStdOut))
+        {
+            status = "Reading zstd files needs the zstd program";
+            return;
+        }
+        read = [&process] (char* buffer, int size) { return process->readProcessOutput (buffer, size); };
+    }
+
+
+    /*
+     * The reader thread hands blocks of decompressed text to this thread
+     * through a short queue, so at most a few blocks are in memory at once.
+     * An empty block marks the end of the stream.
+     */
+    auto queue = std::deque<std::vector<char>>();
+    auto cancelled = false;
+    std::mutex mutex;
+    std::condition_variable condition;
+
+    auto reader = std::thread ([&]
+    {
+        while (true)
+        {
+            auto block = std::vector<char> (blockSize);
+            auto numRead = jmax (0, read (block.data(), blockSize));
+            block.resize (numRead);
+
+            std::unique_lock<std::mutex> lock (mutex);
+            condition.wait (lock, [&] { return int (queue.size()) < maxQueuedBlocks || cancelled; });
+
+            if (cancelled)
+                return;
+
+            queue.push_back (std::move (block));
+            condition.notify_all();
+
+            if (numRead == 0)
+                return;
+        }
+    });
+
+    auto carry = std::vector<char>();
+
+    while (true)
+    {
+        auto block = std::vector<char>();
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+            condition.wait (lock, [&] { return ! queue.empty(); });
+            block = std::move (queue.front());
+            queue.pop_front();
+            condition.notify_all();
+        }
+
+        auto finished = block.empty();
+
+
+        /*
+         * A line cut off at the end of a block is carried over to the next
+         * one. Only the complete lines of each block are parsed.
+         */
+        carry.insert (carry.end(), block.begin(), block.end());
+        block = std::vector<char>();
+
+        auto p = carry.data();
+        auto stop = carry.data() + carry.size();
+
+        if (! finished)
+        {
+            while (stop > p && stop[-1] != '\n')
+                --stop;
+        }
+
+        while (p < stop && status.empty())
+        {
+            auto eol = findEndOfLine (p, stop);
+            parseStreamedLine (p, eol);
+            p = eol + (eol < stop);
+        }
+        carry.erase (carry.begin(), carry.begin() + (stop - carry.data()));
+
+        if (finished || ! status.empty())
+            break;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        cancelled = true;
+        condition.notify_all();
+    }
+    reader.join();
+
+    if (process != nullptr && status.empty() && process->getExitCode() != 0)
+    {
+        status = "Could not decompress " + file.getFileName().toStdString();
+    }
+
+    while (columns.size() < numColumns)
+    {
+        columns.push_back (std::make_unique<Column>());
+    }
+
+    for (auto& column : columns)
+    {
+        column->data = column->getRows (numRows);
+        column->decoded = true;
+    }
+}
+
+bool AsciiLoader::parseStreamedLine (const char* p, const char* eol)
+{
+    numLinesRead += 1;
+
+    if (! isDataLine (p, eol))
+    {
+        if (numRows == 0 && p < eol && *p == '#')
+        {
+            names = splitWords (p, eol);
+            names.erase (names.begin());
+            numColumns = names.size();
+        }
+        return true;
+    }
+
+    if (numRows == 0)
+    {
+        if (names.empty())
+        {
+            numColumns = countWords (p, eol);
+
+            for (int i = 0; i < numColumns; ++i)
+            {
+                names.push_back ("Col " + std::to_string(i));
+            }
+        }
+        for (unsigned long j = 0; j < numColumns; ++j)
+        {
+            columns.push_back (std::make_unique<Column>());
+        }
+    }
+
+    if (countWords (p, eol) != numColumns)
+    {
+        status = "Missing data on line " + std::to_string (numLinesRead);
+        return false;
+    }
+
+    auto x = 0.0;
+
+    for (unsigned long j = 0; j < numColumns; ++j)
+    {
+        while (p < eol && isBlank (*p)) ++p;
+
+        if (! parseNumber (p, eol, x))
+        {
+            status = "Bad number on line " + std::to_string (numLinesRead);
+            return false;
+        }
+        columns[j]->reserveRows (numRows, numRows + 1);
+        columns[j]->storage (int (numRows)) = x;
+    }
+    numRows += 1;
+    return true;
+}
+
+void AsciiLoader::indexRows (Chunk& chunk) const
+{
+    auto p = chunk.begin;
+
+    while (p < chunk.end)
+    {
+        auto eol = findEndOfLine (p, chunk.end);
+        chunk.numLines += 1;
+
+        if (isDataLine (p, eol))
+        {
+            if (countWords (p, eol) != numColumns && chunk.badLine == 0)
+            {
+                chunk.badLine = chunk.numLines;
+            }
+            chunk.rowOffsets.push_back (uint64 (p - begin));
+        }
+        p = eol + (eol < chunk.end);
+    }
+}
+
+void AsciiLoader::parseRows (const Chunk& chunk, int& badLine)
+{
+    auto p = chunk.begin;
+    auto row = chunk.firstRow;
+    auto line = chunk.firstLine;
+
+    while (p < chunk.end)
+    {
+        auto eol = findEndOfLine (p, chunk.end);
+        line += 1;
+
+        if (isDataLine (p, eol))
+        {
+            auto q = p;
+            auto x = 0.0;
+
+            for (unsigned long j = 0; j < numColumns; ++j)
+            {
+                while (q < eol && isBlank (*q)) ++q;
+
+                if (q == eol || ! parseNumber (q, eol, x))
+                {
+                    if (badLine == 0)
+                        badLine = line;
+                    break;
+                }
+                columns[j]->storage (int (row)) = x;
+            }
+            row += 1;
+        }
+        p = eol + (eol < chunk.end);
+    }
+}
+
+int AsciiLoader::findLineNumber (unsigned long row) const
+{
+    for (const auto& chunk : chunks)
+    {
+        if (row >= chunk.firstRow && row < chunk.firstRow + chunk.numRows)
+        {
+            auto offset = begin + rowOffsets[row];
+            return chunk.firstLine + 1 + int (std::count (chunk.begin, offset, '\n'));
+        }
+    }
+    return 0;
+}
+
+bool AsciiLoader::parseNumber (const char*& p, const char* end, double& x)
+{
+    static const double powersOfTen[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    /*
+     * Plain decimal numbers whose mantissa and power of ten are both exactly
+     * representable are converted with one multiplication or division, which
+     * is correctly rounded. Anything else (long mantissas, large exponents,
+     * inf, nan, hex) is handed to strtod.
+     */
+    auto q = p;
+    auto negative = false;
+    auto mantissa = uint64 (0);
+    auto numDigits = 0;
+    auto numSignificant = 0;
+    auto exponent = 0;
+
+    if (q < end && (*q == '+' || *q == '-'))
+    {
+        negative = *q++ == '-';
+    }
+    for (; q < end && *q >= '0' && *q <= '9'; ++q, ++numDigits)
+    {
+        if (mantissa != 0 || *q != '0') ++numSignificant;
+        mantissa = mantissa * 10 + uint64 (*q - '0');
+    }
+    if (q < end && *q == '.')
+    {
+        for (++q; q < end && *q >= '0' && *q <= '9'; ++q, ++numDigits)
+        {
+            if (mantissa != 0 || *q != '0') ++numSignificant;
+            mantissa = mantissa * 10 + uint64 (*q - '0');
+            exponent -= 1;
+        }
+    }
+    if (numDigits > 0 && q < end && (*q == 'e' || *q == 'E'))
+    {
+        auto r = q + 1;
+        auto negativeExponent = false;
+        auto value = 0;
+
+        if (r < end && (*r == '+' || *r == '-'))
+            negativeExponent = *r++ == '-';
+
+        if (r < end && *r >= '0' && *r <= '9')
+        {
+            for (; r < end && *r >= '0' && *r <= '9'; ++r)
+                value = jmin (value * 10 + (*r - '0'), 100000);
+
+            exponent += negativeExponent ? -value : value;
+            q = r;
+        }
+    }
+
+    if (numDigits > 0
+        && numSignificant <= 19
+        && mantissa < (uint64 (1) << 53)
+        && exponent >= -22 && exponent <= 22
+        && (q == end || isSeparator (*q)))
+    {
+        x = exponent < 0 ? double (mantissa) / powersOfTen[-exponent] : double (mantissa) * powersOfTen[exponent];
+        x = negative ? -x : x;
+        p = q;
+        return true;
+    }
+
+    char token[128];
+    auto tokenEnd = p;
+
+    while (tokenEnd < end && ! isSeparator (*tokenEnd) && tokenEnd - p < 127)
+    {
+        ++tokenEnd;
+    }
+    std::memcpy (token, p, tokenEnd - p);
+    token[tokenEnd - p] = '\0';
+
+    char* parsed = nullptr;
+    x = std::strtod (token, &parsed);
+
+    if (parsed == token || *parsed != '\0')
+    {
+        return false;
+    }
+    p = tokenEnd;
+    return true;
+}
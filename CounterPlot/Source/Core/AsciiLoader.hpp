@@ -1,34 +1,141 @@
 #pragma once
 #include <vector>
 #include <string>
+#include "JuceHeader.h"
 
 
 
 
 // =============================================================================
+/**
+ * Loads a whitespace-delimited table of numbers from a text file. An optional
+ * header line beginning with '#' names the columns. The file is memory-mapped
+ * and split into chunks at line boundaries. Each chunk is handed to the
+ * parallelFor function as a separate item, if one is given.
+ *
+ * Construction only indexes the file: it finds the offset of each row, and
+ * checks that every row has the right number of entries. Columns are decoded
+ * when first asked for, by a single scan over the row offsets, or all at once
+ * by loadAllColumns. Decoded columns can be handed out without being copied.
+ *
+ * Files compressed with gzip or zstd are recognised by their magic number.
+ * They are decompressed on a separate thread, block by block, while the
+ * calling thread parses the blocks it has been handed. The text is not kept,
+ * so all of the columns are decoded as the file is read.
+ */
 class AsciiLoader
 {
 public:
-    AsciiLoader (std::istream& stream);
+    using ParallelFor = std::function<void(int, std::function<void(int)>)>;
+
+    AsciiLoader (const File& file, ParallelFor parallelFor=nullptr);
     unsigned long getNumColumns() const;
     unsigned long getNumRows() const;
-    std::vector<double> getColumnData (int index) const;
-    std::vector<double> getRowData (int index) const;
+    std::vector<double> getColumnData (int index);
+    std::vector<double> getRowData (int index);
     std::string getColumnName (int index) const;
     std::string getStatusMessage() const;
 
+    /**
+     * Return the column at the given index, decoding it if that has not been
+     * done yet. The array shares its memory with the loader's. This method
+     * may be called from any thread. It throws if an entry in the column is
+     * not a number, or if the file has changed on disk since it was indexed.
+     */
+    nd::array<double, 1> getColumn (int index);
+
+    /**
+     * Return the column at the given index in single precision. If the column
+     * has not been decoded, it is decoded straight to float and is not kept by
+     * the loader, so no double precision copy of it is made. If it has, the
+     * narrowed column is kept alongside it, and after rows are appended only
+     * the new rows are narrowed.
+     */
+    nd::array<float, 1> getFloatColumn (int index);
+
+    /**
+     * Decode all the columns in one pass over the file. This is faster than
+     * asking for each column in turn, if all of them are needed. Any entries
+     * that are not numbers are reported in the status message.
+     */
+    void loadAllColumns (ParallelFor parallelFor=nullptr);
+
+    /**
+     * Bring the loader up to date with a file that has only been appended to
+     * since it was loaded: the new rows are indexed and, if every column has
+     * been decoded, parsed and added to the end of the columns. Return false
+     * if the file has changed in any other way (or the last line was not
+     * complete), in which case it should be loaded again from scratch.
+     */
+    bool appendNewRows (const File& file);
+
     template <class OutputIterator>
     void column (int j, OutputIterator iter)
     {
+        auto data = getColumn (j);
+
         for (int i = 0; i < numRows; ++i)
         {
-            *iter++ = data[i * numColumns + j];
+            *iter++ = data(i);
         }
     }
 private:
+    struct Chunk
+    {
+        const char* begin = nullptr;
+        const char* end = nullptr;
+        std::vector<uint64> rowOffsets;
+        unsigned long firstRow = 0;
+        unsigned long numRows = 0;
+        int firstLine = 0;
+        int numLines = 0;
+        int badLine = 0;
+    };
+    /**
+     * A decoded column is a view of the first numRows entries of its storage.
+     * Columns that grow (as a compressed file is streamed in, or rows are
+     * appended) have room for more rows than they hold, so that growing them
+     * by a row at a time only copies the column a logarithmic number of times.
+     * The first numFloatRows entries of floatStorage are the column narrowed
+     * to single precision, for getFloatColumn.
+     */
+    struct Column
+    {
+        void reserveRows (unsigned long numUsed, unsigned long numRequired);
+        nd::array<double, 1> getRows (unsigned long numRows) const;
+        nd::array<float, 1> getFloatRows (unsigned long numRows);
+        void clear();
+        CriticalSection lock;
+        bool decoded = false;
+        nd::array<double, 1> data;
+        nd::array<double, 1> storage;
+        nd::array<float, 1> floatStorage;
+        unsigned long numFloatRows = 0;
+    };
+    enum class Compression { none, gzip, zstd };
+    static Compression detectCompression (const File& file);
+    void loadCompressed (const File& file, Compression compression);
+    bool parseStreamedLine (const char* p, const char* eol);
+    template <typename ValueType>
+    nd::array<ValueType, 1> decodeColumn (int index);
+    void indexRows (Chunk& chunk) const;
+    void parseRows (const Chunk& chunk, int& badLine);
+    int findLineNumber (unsigned long row) const;
+    static bool parseNumber (const char*& p, const char* end, double& x);
+
+    std::unique_ptr<MemoryMappedFile> mapped;
+    File source;
+    Time sourceModified;
+    const char* begin = nullptr;
+    const char* end = nullptr;
     unsigned long numColumns = 0;
     unsigned long numRows = 0;
-    std::vector<double> data;
+    std::vector<Chunk> chunks;
+    std::vector<uint64> rowOffsets;
+    std::vector<std::unique_ptr<Column>> columns;
     std::vector<std::string> names;
     std::string status;
+    std::vector<char> tail;
+    bool streamed = false;
+    int numLinesRead = 0;
 };
@@ -53,12 +53,14 @@ void ConfigurableFileFilter::requirePatches2dField (const String &fieldThatMustE
 //=============================================================================
 bool ConfigurableFileFilter::isFileSuitable (const File& file) const
 {
-    return isPathSuitable (file) && wildcardFilter.isFileSuitable (file);
+    // The wildcard goes first, so that files it rejects are never queued for
+    // an HDF5 probe (or added to the metadata index).
+    return wildcardFilter.isFileSuitable (file) && isPathSuitable (file);
 }
 
 bool ConfigurableFileFilter::isDirectorySuitable (const File& file) const
 {
-    return isPathSuitable (file) && wildcardFilter.isDirectorySuitable (file);
+    return wildcardFilter.isDirectorySuitable (file) && isPathSuitable (file);
 }
 
 bool ConfigurableFileFilter::isPathSuitable (const File& file) const
@@ -68,37 +70,34 @@ bool ConfigurableFileFilter::isPathSuitable (const File& file) const
         return false;
     }
 
-    for (const auto& requirement : hdf5Requirements)
+    if (! hdf5Requirements.isEmpty())
     {
-        ScopedLock lock (DataHelpers::getCriticalSectionForHDF5());
+        // The requirements are answered from the HDF5 metadata index, which
+        // never waits on the file. A file it has not indexed yet is probed in
+        // the background, and is not suitable until the index says otherwise
+        // (its listeners are told when the probe finishes).
+        // --------------------------------------------------------------------
+        auto locations = StringArray();
 
-        if (! h5::File::exists (file.getFullPathName().toStdString()))
-        {
-            return false;
-        }
-        auto h5f = h5::File (file.getFullPathName().toStdString(), "r");
+        for (const auto& requirement : hdf5Requirements)
+            locations.add (requirement.location);
 
-        if (requirement.type == 'g')
+        auto described = hdf5Index->describe (file, locations);
+
+        for (int n = 0; n < hdf5Requirements.size(); ++n)
         {
-            try {
-                h5f.open_group (requirement.location.toStdString());
-            }
-            catch (const std::exception& e)
+            const auto& requirement = hdf5Requirements.getReference (n);
+            const auto& location = described.getReference (n);
+
+            if (! location.exists)
             {
                 return false;
             }
-        }
-        else if (requirement.type == 'd')
-        {
-            try {
-                auto h5d = h5f.open_dataset (requirement.location.toStdString());
-
-                if (requirement.rank != -1 && requirement.rank != h5d.get_space().rank())
-                {
-                    return false;
-                }
+            if (requirement.type == 'g' && ! location.isGroup)
+            {
+                return false;
             }
-            catch (const std::exception& e)
+            if (requirement.type == 'd' && (location.isGroup || (requirement.rank != -1 && requirement.rank != location.rank)))
             {
                 return false;
             }
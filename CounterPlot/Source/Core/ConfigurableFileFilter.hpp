@@ -1,5 +1,6 @@
 #pragma once
 #include "JuceHeader.h"
+#include "HDF5MetadataIndex.hpp"
 
 
 
@@ -74,4 +75,5 @@ private:
     Array<HDF5Requirements> hdf5Requirements;
     StringArray pathches2dFieldRequirements;
     bool rejectAllFiles = false;
+    SharedResourcePointer<HDF5MetadataIndex> hdf5Index;
 };
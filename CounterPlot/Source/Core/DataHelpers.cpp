@@ -377,13 +377,3 @@ nd::array<double, 1> DataHelpers::ndarrayDouble1FromVar(const var &value)
     }
     return var();
 }
-
-
-
-
-//=============================================================================
-CriticalSection& DataHelpers::getCriticalSectionForHDF5()
-{
-    static CriticalSection section;
-    return section;
-}
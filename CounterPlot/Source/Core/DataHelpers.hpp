@@ -30,45 +30,4 @@ public:
     static StringPairArray stringPairArrayFromVar (const var&);
     static std::map<std::string, std::string> stringMapFromVar (const var&);
     static nd::array<double, 1> ndarrayDouble1FromVar (const var&);
-
-    static CriticalSection& getCriticalSectionForHDF5();
-};
-
-
-
-
-//=============================================================================
-class FilePoller : public Timer
-{
-public:
-
-    //=========================================================================
-    void setCallback (std::function<void(File)> callbackToInvoke)
-    {
-        callback = callbackToInvoke;
-    }
-
-    void setFileToPoll (File fileToPoll)
-    {
-        startTimer (100);
-        file = fileToPoll;
-        lastNotified = Time::getCurrentTime();
-    }
-
-    //=========================================================================
-    void timerCallback() override
-    {
-        if (lastNotified < file.getLastModificationTime())
-        {
-            lastNotified = Time::getCurrentTime();
-
-            if (callback)
-                callback (file);
-        }
-    }
-
-private:
-    Time lastNotified;
-    File file;
-    std::function<void(File)> callback = nullptr;
 };
@@ -0,0 +1,226 @@
+#include "DirectoryListingCache.hpp"
+
+
+
+
+//=============================================================================
+DirectoryListingCache::DirectoryListingCache() : Thread ("DirectoryListingCache")
+{
+    startThread();
+}
+
+DirectoryListingCache::~DirectoryListingCache()
+{
+    signalThreadShouldExit();
+    requestAdded.signal();
+    stopThread (4000);
+    cancelPendingUpdate();
+    fileNotifications->unsubscribeAll (this);
+}
+
+void DirectoryListingCache::addListener (Listener* listener)
+{
+    listeners.add (listener);
+}
+
+void DirectoryListingCache::removeListener (Listener* listener)
+{
+    listeners.remove (listener);
+}
+
+bool DirectoryListingCache::getListing (const File& directory, Array<Entry>& entries)
+{
+    const ScopedLock sl (lock);
+    auto listing = listings.find (directory.getFullPathName());
+
+    if (listing == listings.end())
+    {
+        return false;
+    }
+    listing->second.lastUsed = ++useCounter;
+    entries = listing->second.entries;
+    return true;
+}
+
+void DirectoryListingCache::requestListing (const File& directory)
+{
+    const ScopedLock sl (lock);
+    auto path = directory.getFullPathName();
+
+    if (listings.count (path) || queued.count (path))
+    {
+        return;
+    }
+    queue.push_back (directory);
+    queued.insert (path);
+    requestAdded.signal();
+}
+
+
+
+
+//=============================================================================
+void DirectoryListingCache::run()
+{
+    while (! threadShouldExit())
+    {
+        auto directory = File();
+        {
+            const ScopedLock sl (lock);
+
+            if (! queue.empty())
+            {
+                directory = queue.front();
+                queue.pop_front();
+            }
+        }
+
+        if (directory == File())
+        {
+            requestAdded.wait (-1);
+            continue;
+        }
+
+        scan (directory);
+
+        const ScopedLock sl (lock);
+        queued.erase (directory.getFullPathName());
+    }
+}
+
+void DirectoryListingCache::handleAsyncUpdate()
+{
+    auto ready = std::vector<Result>();
+    {
+        const ScopedLock sl (lock);
+        ready.swap (results);
+    }
+
+    for (const auto& result : ready)
+    {
+        if (result.changed)
+            listeners.call (&Listener::directoryListingChanged, result.directory);
+        else if (result.complete)
+            listeners.call (&Listener::directoryListingCompleted, result.directory, result.entries);
+        else
+            listeners.call (&Listener::directoryListingBatchFound, result.directory, result.entries);
+    }
+}
+
+void DirectoryListingCache::fileNotificationServiceFilesChanged (const Array<File>& changedFiles)
+{
+    // Directories are subscribed to for changes to their entries only, so
+    // each changed file is a directory whose listing is out of date, and
+    // writes to the files in it are never reported.
+    // ------------------------------------------------------------------------
+    const ScopedLock sl (lock);
+
+    for (const auto& file : changedFiles)
+    {
+        auto path = file.getFullPathName();
+
+        // A directory being scanned is marked, so that the listing is
+        // dropped as soon as the scan finishes.
+        // --------------------------------------------------------------------
+        if (queued.count (path))
+        {
+            invalidated.insert (path);
+        }
+        else if (listings.count (path))
+        {
+            listings.erase (path);
+            fileNotifications->unsubscribe (this, File (path));
+            post ({ File (path), {}, false, true });
+        }
+    }
+}
+
+
+
+
+//=============================================================================
+void DirectoryListingCache::scan (const File& directory)
+{
+    const int batchSize = 1000;
+    const double batchInterval = 100.0;
+
+    auto path = directory.getFullPathName();
+    auto found = Array<Entry>();
+    auto batch = Array<Entry>();
+    auto lastPosted = Time::getMillisecondCounterHiRes();
+    auto isDirectory = false;
+    auto isHidden = false;
+
+    fileNotifications->subscribe (this, directory, FileNotificationService::Changes::entries);
+    {
+        const ScopedLock sl (lock);
+        invalidated.erase (path);
+    }
+
+    DirectoryIterator iter (directory, false, "*", File::findFilesAndDirectories | File::ignoreHiddenFiles);
+
+    while (iter.next (&isDirectory, &isHidden, nullptr, nullptr, nullptr, nullptr))
+    {
+        if (threadShouldExit())
+        {
+            return;
+        }
+        if (isHidden)
+        {
+            continue;
+        }
+
+        auto entry = Entry();
+        entry.file = iter.getFile();
+        entry.isDirectory = isDirectory;
+        found.add (entry);
+        batch.add (entry);
+
+        if (batch.size() >= batchSize || Time::getMillisecondCounterHiRes() - lastPosted > batchInterval)
+        {
+            post ({ directory, batch, false, false });
+            batch.clearQuick();
+            lastPosted = Time::getMillisecondCounterHiRes();
+        }
+    }
+
+    std::sort (found.begin(), found.end(), [] (const Entry& a, const Entry& b)
+    {
+        if (a.isDirectory != b.isDirectory)
+            return a.isDirectory;
+        return a.file.getFileName() < b.file.getFileName();
+    });
+
+    const ScopedLock sl (lock);
+    post ({ directory, found, true, false });
+
+    if (invalidated.erase (path))
+    {
+        fileNotifications->unsubscribe (this, directory);
+        post ({ directory, {}, false, true });
+        return;
+    }
+
+    listings[path] = { found, ++useCounter };
+    evictLeastRecentlyUsed();
+}
+
+void DirectoryListingCache::post (Result result)
+{
+    const ScopedLock sl (lock);
+    results.push_back (std::move (result));
+    triggerAsyncUpdate();
+}
+
+void DirectoryListingCache::evictLeastRecentlyUsed()
+{
+    while (int (listings.size()) > maximumListings)
+    {
+        auto oldest = std::min_element (listings.begin(), listings.end(), [] (const auto& a, const auto& b)
+        {
+            return a.second.lastUsed < b.second.lastUsed;
+        });
+        fileNotifications->unsubscribe (this, File (oldest->first));
+        listings.erase (oldest);
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include "JuceHeader.h"
+#include "FileNotificationService.hpp"
+
+
+
+
+//=============================================================================
+/**
+ * A process-wide cache of directory listings, made on a background thread.
+ * A listing that is not cached is scanned when requested; while the scan is
+ * running, listeners receive the entries found so far in batches, and when
+ * it's finished, the whole listing sorted with directories first, then by
+ * name. Hidden files are left out.
+ *
+ * Each cached directory is watched through the file notification service,
+ * and its listing is dropped (and listeners told) only when something in it
+ * changes. The least recently used listings are dropped once more than a
+ * few hundred directories are cached.
+ *
+ * Obtain the cache through a SharedResourcePointer<DirectoryListingCache>.
+ * Listeners are called on the message thread.
+ */
+class DirectoryListingCache : private Thread, private AsyncUpdater, private FileNotificationService::Listener
+{
+public:
+
+
+    //=========================================================================
+    struct Entry
+    {
+        File file;
+        bool isDirectory = false;
+    };
+
+
+    //=========================================================================
+    class Listener
+    {
+    public:
+        virtual ~Listener() {}
+
+        /** Called with entries found by a scan that is still running. */
+        virtual void directoryListingBatchFound (const File& directory, const Array<Entry>& entries) = 0;
+
+        /** Called with the complete, sorted listing when a scan finishes. */
+        virtual void directoryListingCompleted (const File& directory, const Array<Entry>& entries) = 0;
+
+        /** Called when a cached listing is dropped because the directory changed. */
+        virtual void directoryListingChanged (const File& directory) = 0;
+    };
+
+
+    //=========================================================================
+    DirectoryListingCache();
+    ~DirectoryListingCache();
+    void addListener (Listener* listener);
+    void removeListener (Listener* listener);
+
+
+    /**
+     * Put the cached listing of the directory in entries and return true, or
+     * return false if it is not cached.
+     */
+    bool getListing (const File& directory, Array<Entry>& entries);
+
+
+    /**
+     * Scan the directory in the background, unless its listing is cached or
+     * a scan of it is already queued or running.
+     */
+    void requestListing (const File& directory);
+
+
+private:
+
+
+    //=========================================================================
+    struct Listing
+    {
+        Array<Entry> entries;
+        uint64 lastUsed = 0;
+    };
+
+    struct Result
+    {
+        File directory;
+        Array<Entry> entries;
+        bool complete = false;
+        bool changed = false;
+    };
+
+
+    //=========================================================================
+    void run() override;
+    void handleAsyncUpdate() override;
+    void fileNotificationServiceFilesChanged (const Array<File>& changedFiles) override;
+    void scan (const File& directory);
+    void post (Result result);
+    void evictLeastRecentlyUsed();
+
+    CriticalSection lock;
+    WaitableEvent requestAdded;
+    std::map<String, Listing> listings;
+    std::deque<File> queue;
+    std::set<String> queued;
+    std::set<String> invalidated;
+    std::vector<Result> results;
+    uint64 useCounter = 0;
+    int maximumListings = 256;
+    ListenerList<Listener> listeners;
+    SharedResourcePointer<FileNotificationService> fileNotifications;
+};
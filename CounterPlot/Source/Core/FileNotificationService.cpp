@@ -0,0 +1,687 @@
+#include "FileNotificationService.hpp"
+
+#if JUCE_LINUX
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#elif JUCE_MAC
+#include <fcntl.h>
+#include <sys/event.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * How long, in milliseconds, the background thread waits before trying again
+ * to watch a directory that could not be opened (e.g. one that was deleted).
+ */
+static const int watchRetryInterval = 1000;
+
+
+
+
+//=============================================================================
+FileNotificationService::FileNotificationService() : Thread ("FileNotificationService")
+{
+#if JUCE_LINUX
+    inotifyDescriptor = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+#elif JUCE_MAC
+    kqueueDescriptor = kqueue();
+#endif
+
+#if JUCE_LINUX || JUCE_MAC
+    if (pipe (wakeupPipe) == 0)
+    {
+        fcntl (wakeupPipe[0], F_SETFL, O_NONBLOCK);
+        fcntl (wakeupPipe[1], F_SETFL, O_NONBLOCK);
+    }
+#endif
+
+#if JUCE_MAC
+    if (kqueueDescriptor != -1 && wakeupPipe[0] != -1)
+    {
+        struct kevent change;
+        EV_SET (&change, wakeupPipe[0], EVFILT_READ, EV_ADD, 0, 0, nullptr);
+        kevent (kqueueDescriptor, &change, 1, nullptr, 0, nullptr);
+    }
+#endif
+    startThread();
+}
+
+FileNotificationService::~FileNotificationService()
+{
+    signalThreadShouldExit();
+    wakeThread();
+    stopThread (4000);
+    cancelPendingUpdate();
+
+#if JUCE_LINUX
+    for (auto fd : { inotifyDescriptor, wakeupPipe[0], wakeupPipe[1] })
+        if (fd != -1)
+            close (fd);
+#elif JUCE_MAC
+    for (const auto& item : pathsByDescriptor)
+        close (item.first);
+
+    for (auto fd : { kqueueDescriptor, wakeupPipe[0], wakeupPipe[1] })
+        if (fd != -1)
+            close (fd);
+#endif
+}
+
+void FileNotificationService::subscribe (Listener* listener, const File& fileOrDirectory, Changes changes)
+{
+    {
+        const ScopedLock sl (lock);
+
+        for (const auto& subscription : subscriptions)
+            if (subscription.listener == listener && subscription.target == fileOrDirectory)
+                return;
+
+        auto subscription = Subscription();
+        subscription.listener = listener;
+        subscription.target = fileOrDirectory;
+        subscription.changes = changes;
+        subscriptions.push_back (subscription);
+    }
+    wakeThread();
+}
+
+void FileNotificationService::unsubscribe (Listener* listener, const File& fileOrDirectory)
+{
+    {
+        const ScopedLock sl (lock);
+        auto s = std::find_if (subscriptions.begin(), subscriptions.end(), [&] (const auto& subscription)
+        {
+            return subscription.listener == listener && subscription.target == fileOrDirectory;
+        });
+
+        if (s == subscriptions.end())
+            return;
+
+        subscriptions.erase (s);
+    }
+    wakeThread();
+}
+
+void FileNotificationService::unsubscribeAll (Listener* listener)
+{
+    {
+        const ScopedLock sl (lock);
+        auto s = std::remove_if (subscriptions.begin(), subscriptions.end(), [listener] (const auto& subscription)
+        {
+            return subscription.listener == listener;
+        });
+
+        if (s == subscriptions.end())
+            return;
+
+        subscriptions.erase (s, subscriptions.end());
+    }
+    wakeThread();
+}
+
+
+
+
+//=============================================================================
+void FileNotificationService::run()
+{
+    while (! threadShouldExit())
+    {
+        // New subscriptions are looked at, and watches opened or closed, here
+        // rather than on the subscriber's thread. Without inotify or kqueue,
+        // the modification time of each subscribed path is compared twice a
+        // second instead of waiting for events.
+        // --------------------------------------------------------------------
+        resolveSubscriptions();
+        updateWatches();
+
+        if (! waitForEvents())
+            pollSubscriptions();
+
+        const ScopedLock sl (lock);
+
+        if (! pending.empty())
+            triggerAsyncUpdate();
+    }
+}
+
+void FileNotificationService::handleAsyncUpdate()
+{
+    auto batches = std::map<Listener*, std::set<String>>();
+    {
+        const ScopedLock sl (lock);
+
+        for (const auto& item : pending)
+        {
+            auto file = File (item.first);
+
+            for (const auto& subscription : subscriptions)
+            {
+                if (matches (subscription, file, item.second))
+                {
+                    auto reported = subscription.changes == Changes::entries ? subscription.target : file;
+                    batches[subscription.listener].insert (reported.getFullPathName());
+                }
+            }
+        }
+        pending.clear();
+    }
+
+    // A listener may unsubscribe others (or itself) from its callback, so
+    // each is checked again just before it is called.
+    // ------------------------------------------------------------------------
+    for (const auto& batch : batches)
+    {
+        if (isSubscribed (batch.first))
+        {
+            auto files = Array<File>();
+
+            for (const auto& path : batch.second)
+                files.add (File (path));
+
+            batch.first->fileNotificationServiceFilesChanged (files);
+        }
+    }
+}
+
+
+
+
+//=============================================================================
+void FileNotificationService::resolveSubscriptions()
+{
+    auto unresolved = std::set<String>();
+    {
+        const ScopedLock sl (lock);
+
+        for (const auto& subscription : subscriptions)
+            if (! subscription.resolved)
+                unresolved.insert (subscription.target.getFullPathName());
+    }
+
+    if (unresolved.empty())
+    {
+        return;
+    }
+
+    auto directories = std::set<String>();
+    auto modified = std::map<String, Time>();
+
+    for (const auto& path : unresolved)
+    {
+        auto file = File (path);
+
+        if (file.isDirectory())
+            directories.insert (path);
+
+        modified[path] = file.getLastModificationTime();
+    }
+
+    const ScopedLock sl (lock);
+
+    for (auto& subscription : subscriptions)
+    {
+        auto path = subscription.target.getFullPathName();
+
+        if (! subscription.resolved && unresolved.count (path))
+        {
+            subscription.resolved = true;
+            subscription.isDirectory = directories.count (path) > 0;
+            subscription.watched = subscription.isDirectory ? subscription.target : subscription.target.getParentDirectory();
+            subscription.modified = modified[path];
+        }
+    }
+}
+
+void FileNotificationService::updateWatches()
+{
+    auto wanted = std::map<String, std::set<String>>();
+    {
+        const ScopedLock sl (lock);
+
+        for (const auto& subscription : subscriptions)
+        {
+            if (subscription.resolved)
+            {
+                auto& files = wanted[subscription.watched.getFullPathName()];
+
+                if (! subscription.isDirectory)
+                    files.insert (subscription.target.getFullPathName());
+            }
+        }
+    }
+
+    for (auto watch = watches.begin(); watch != watches.end();)
+    {
+        if (wanted.count (watch->first))
+        {
+            ++watch;
+            continue;
+        }
+        closeWatch (watch->second);
+        watch = watches.erase (watch);
+    }
+
+    for (const auto& item : wanted)
+    {
+        auto& watch = watches[item.first];
+
+        if (watch.descriptor == -1 && openWatch (item.first, watch) && watch.lost)
+        {
+            // The directory had gone away and is back, so whatever was
+            // subscribed in it may have changed.
+            // ----------------------------------------------------------------
+            post (File (item.first), true, true);
+
+            for (const auto& file : item.second)
+                post (File (file), true, true);
+
+#if JUCE_MAC
+            reopenFiles (watch);
+#endif
+        }
+        watch.lost = watch.descriptor == -1;
+
+#if JUCE_MAC
+        for (auto file = watch.files.begin(); file != watch.files.end();)
+        {
+            if (item.second.count (file->first))
+            {
+                ++file;
+                continue;
+            }
+            if (file->second != -1)
+                closeVnode (file->second);
+
+            file = watch.files.erase (file);
+        }
+
+        for (const auto& file : item.second)
+            if (! watch.files.count (file))
+                watch.files[file] = openVnode (file);
+#endif
+    }
+}
+
+bool FileNotificationService::openWatch (const String& path, Watch& watch)
+{
+#if JUCE_LINUX
+    if (inotifyDescriptor != -1)
+    {
+        auto mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+        watch.descriptor = inotify_add_watch (inotifyDescriptor, path.toRawUTF8(), mask);
+
+        if (watch.descriptor != -1)
+            pathsByDescriptor[watch.descriptor] = path;
+    }
+#elif JUCE_MAC
+    if (kqueueDescriptor != -1)
+    {
+        watch.descriptor = openVnode (path);
+    }
+#else
+    ignoreUnused (path);
+#endif
+    return watch.descriptor != -1;
+}
+
+void FileNotificationService::closeWatch (Watch& watch)
+{
+#if JUCE_LINUX
+    if (watch.descriptor != -1)
+    {
+        inotify_rm_watch (inotifyDescriptor, watch.descriptor);
+        pathsByDescriptor.erase (watch.descriptor);
+    }
+#elif JUCE_MAC
+    if (watch.descriptor != -1)
+    {
+        closeVnode (watch.descriptor);
+    }
+    for (const auto& file : watch.files)
+        if (file.second != -1)
+            closeVnode (file.second);
+#endif
+    watch.descriptor = -1;
+    watch.files.clear();
+}
+
+bool FileNotificationService::hasUnopenedWatches() const
+{
+    for (const auto& watch : watches)
+        if (watch.second.descriptor == -1)
+            return true;
+
+    return false;
+}
+
+bool FileNotificationService::waitForEvents()
+{
+#if JUCE_LINUX
+    if (inotifyDescriptor == -1 || wakeupPipe[0] == -1)
+    {
+        return false;
+    }
+
+    // Block until inotify has events or another thread writes to the wakeup
+    // pipe. The wait only times out while some directory could not be
+    // watched, so that it is tried again.
+    // ------------------------------------------------------------------------
+    pollfd fds[2] = { { inotifyDescriptor, POLLIN, 0 }, { wakeupPipe[0], POLLIN, 0 } };
+
+    if (poll (fds, 2, hasUnopenedWatches() ? watchRetryInterval : -1) <= 0)
+    {
+        return true;
+    }
+    if (fds[1].revents & POLLIN)
+    {
+        drainWakeupPipe();
+    }
+
+    alignas (inotify_event) char buffer[16384];
+    ssize_t length;
+
+    while ((length = read (inotifyDescriptor, buffer, sizeof (buffer))) > 0)
+    {
+        for (auto p = buffer; p < buffer + length;)
+        {
+            auto event = reinterpret_cast<const inotify_event*> (p);
+            p += sizeof (inotify_event) + event->len;
+
+            auto directory = pathsByDescriptor.find (event->wd);
+
+            if (directory == pathsByDescriptor.end())
+                continue;
+
+            // The directory was deleted or moved away. Its watch is reset,
+            // so that it is watched again if the directory comes back.
+            // ----------------------------------------------------------------
+            if (event->mask & IN_IGNORED)
+            {
+                auto watch = watches.find (directory->second);
+
+                if (watch != watches.end())
+                {
+                    watch->second.descriptor = -1;
+                    watch->second.lost = true;
+                }
+                pathsByDescriptor.erase (directory);
+                continue;
+            }
+
+            auto entriesChanged = (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)) != 0;
+
+            if (event->len > 0)
+                post (File (directory->second).getChildFile (event->name), entriesChanged);
+            else
+                post (File (directory->second), entriesChanged);
+        }
+    }
+    return true;
+
+#elif JUCE_MAC
+    if (kqueueDescriptor == -1 || wakeupPipe[0] == -1)
+    {
+        return false;
+    }
+
+    // Block until a watched directory or file changes, or another thread
+    // writes to the wakeup pipe. The wait only times out while some directory
+    // could not be watched, so that it is tried again.
+    // ------------------------------------------------------------------------
+    struct kevent events[64];
+    auto retry = timespec { watchRetryInterval / 1000, 0 };
+    auto numEvents = kevent (kqueueDescriptor, nullptr, 0, events, 64, hasUnopenedWatches() ? &retry : nullptr);
+    auto changedDirectories = std::set<String>();
+
+    for (int n = 0; n < numEvents; ++n)
+    {
+        if (events[n].filter == EVFILT_READ)
+        {
+            drainWakeupPipe();
+            continue;
+        }
+
+        auto descriptor = int (events[n].ident);
+        auto item = pathsByDescriptor.find (descriptor);
+
+        if (item == pathsByDescriptor.end())
+            continue;
+
+        auto path = item->second;
+        auto gone = (events[n].fflags & (NOTE_DELETE | NOTE_RENAME)) != 0;
+        auto watch = watches.find (path);
+
+        // kqueue does not say which children of a directory changed, so the
+        // directory itself is reported. Files subscribed in it are checked
+        // for having been created, deleted, or replaced.
+        // --------------------------------------------------------------------
+        if (watch != watches.end() && watch->second.descriptor == descriptor)
+        {
+            post (File (path), true, true);
+
+            if (gone)
+            {
+                closeVnode (descriptor);
+                watch->second.descriptor = -1;
+                watch->second.lost = true;
+            }
+            else
+            {
+                changedDirectories.insert (path);
+            }
+        }
+        else
+        {
+            post (File (path), gone, true);
+
+            if (gone)
+                changedDirectories.insert (File (path).getParentDirectory().getFullPathName());
+        }
+    }
+
+    for (const auto& path : changedDirectories)
+    {
+        auto watch = watches.find (path);
+
+        if (watch != watches.end())
+            reopenFiles (watch->second);
+    }
+    return true;
+
+#else
+    return false;
+#endif
+}
+
+void FileNotificationService::pollSubscriptions()
+{
+    wakeup.wait (500);
+
+    auto modified = std::map<String, Time>();
+    {
+        const ScopedLock sl (lock);
+
+        for (const auto& subscription : subscriptions)
+            if (subscription.resolved)
+                modified[subscription.target.getFullPathName()] = Time();
+    }
+
+    for (auto& item : modified)
+        item.second = File (item.first).getLastModificationTime();
+
+    const ScopedLock sl (lock);
+
+    for (auto& subscription : subscriptions)
+    {
+        auto item = modified.find (subscription.target.getFullPathName());
+
+        if (subscription.resolved && item != modified.end() && item->second != subscription.modified)
+        {
+            subscription.modified = item->second;
+            post (subscription.target, true, true);
+        }
+    }
+}
+
+void FileNotificationService::wakeThread()
+{
+    wakeup.signal();
+
+#if JUCE_LINUX || JUCE_MAC
+    if (wakeupPipe[1] != -1)
+    {
+        char byte = 0;
+        ignoreUnused (write (wakeupPipe[1], &byte, 1));
+    }
+#endif
+}
+
+void FileNotificationService::drainWakeupPipe()
+{
+#if JUCE_LINUX || JUCE_MAC
+    char bytes[64];
+
+    while (read (wakeupPipe[0], bytes, sizeof (bytes)) > 0)
+    {
+    }
+#endif
+}
+
+
+
+
+//=============================================================================
+#if JUCE_MAC
+void FileNotificationService::reopenFiles (Watch& watch)
+{
+    for (auto& file : watch.files)
+    {
+        auto wasOpen = file.second != -1;
+
+        if (wasOpen && refersTo (file.second, file.first))
+            continue;
+
+        if (wasOpen)
+            closeVnode (file.second);
+
+        file.second = openVnode (file.first);
+
+        if (wasOpen || file.second != -1)
+            post (File (file.first), true, true);
+    }
+}
+
+int FileNotificationService::openVnode (const String& path)
+{
+    auto descriptor = open (path.toRawUTF8(), O_EVTONLY);
+
+    if (descriptor != -1)
+    {
+        struct kevent change;
+        EV_SET (&change, descriptor, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_DELETE | NOTE_RENAME, 0, nullptr);
+        kevent (kqueueDescriptor, &change, 1, nullptr, 0, nullptr);
+        pathsByDescriptor[descriptor] = path;
+    }
+    return descriptor;
+}
+
+void FileNotificationService::closeVnode (int descriptor)
+{
+    close (descriptor);
+    pathsByDescriptor.erase (descriptor);
+}
+
+bool FileNotificationService::refersTo (int descriptor, const String& path)
+{
+    struct stat opened, named;
+    return fstat (descriptor, &opened) == 0
+        && stat (path.toRawUTF8(), &named) == 0
+        && opened.st_dev == named.st_dev
+        && opened.st_ino == named.st_ino;
+}
+#endif
+
+void FileNotificationService::post (const File& changed, bool entriesChanged, bool exact)
+{
+    const ScopedLock sl (lock);
+    auto& change = pending[changed.getFullPathName()];
+    change.entries = change.entries || entriesChanged;
+    change.exact = exact;
+}
+
+bool FileNotificationService::isSubscribed (Listener* listener) const
+{
+    const ScopedLock sl (lock);
+
+    for (const auto& subscription : subscriptions)
+        if (subscription.listener == listener)
+            return true;
+
+    return false;
+}
+
+bool FileNotificationService::matches (const Subscription& subscription, const File& changed, const Change& change)
+{
+    if (subscription.changes == Changes::entries && ! change.entries)
+    {
+        return false;
+    }
+    if (changed == subscription.target)
+    {
+        return true;
+    }
+    return ! change.exact && subscription.isDirectory && changed.getParentDirectory() == subscription.target;
+}
+
+
+
+
+//=============================================================================
+void FileSettleTimer::setCallback (std::function<void(File)> callbackToInvoke)
+{
+    callback = callbackToInvoke;
+}
+
+void FileSettleTimer::setSettleInterval (int milliseconds)
+{
+    settleInterval = milliseconds;
+}
+
+void FileSettleTimer::fileChanged (const File& changedFile)
+{
+    file = changedFile;
+    size = file.getSize();
+    modified = file.getLastModificationTime();
+    lastChange = Time::getMillisecondCounterHiRes();
+    startTimer (100);
+}
+
+void FileSettleTimer::cancel()
+{
+    stopTimer();
+}
+
+void FileSettleTimer::timerCallback()
+{
+    auto newSize = file.getSize();
+    auto newModified = file.getLastModificationTime();
+    auto now = Time::getMillisecondCounterHiRes();
+
+    if (newSize != size || newModified != modified)
+    {
+        size = newSize;
+        modified = newModified;
+        lastChange = now;
+    }
+    else if (now - lastChange >= settleInterval)
+    {
+        stopTimer();
+
+        if (callback)
+            callback (file);
+    }
+}
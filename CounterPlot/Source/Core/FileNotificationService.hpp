@@ -0,0 +1,214 @@
+#pragma once
+#include "JuceHeader.h"
+
+
+
+
+//=============================================================================
+/**
+ * A process-wide service that tells subscribers when files or directories
+ * change on disk. Subscribing to a file reports changes to that file,
+ * including it being replaced, created, or deleted. Subscribing to a
+ * directory reports changes to any of its immediate children or, with
+ * Changes::entries, only changes to which children it has.
+ *
+ * On Linux the service is built on inotify: the parent directory of each
+ * subscribed path is watched, and a background thread blocks on the inotify
+ * descriptor, so nothing runs while the filesystem is idle. On macOS it is
+ * built on kqueue in the same way, but kqueue only says that a directory's
+ * entries changed, not which ones, so a subscribed directory is reported
+ * as a whole and writes to its children are not seen; subscribed files are
+ * watched individually. On other platforms the background thread compares
+ * the modification time of each subscribed path every half second instead,
+ * with the same limits as kqueue.
+ *
+ * Subscribing and unsubscribing only record the request; the background
+ * thread does all the filesystem work. Listeners are called on the message
+ * thread, with every change that arrived since they were last called, in
+ * one batch.
+ *
+ * Obtain the service through a SharedResourcePointer<FileNotificationService>.
+ * Listeners must unsubscribe before they are destroyed.
+ */
+class FileNotificationService : private Thread, private AsyncUpdater
+{
+public:
+
+
+    //=========================================================================
+    class Listener
+    {
+    public:
+        virtual ~Listener() {}
+
+        /**
+         * Called on the message thread with the paths that changed since the
+         * last call. For a subscribed directory, these are its children, or
+         * the directory itself if it was subscribed with Changes::entries or
+         * the platform cannot tell which children changed.
+         */
+        virtual void fileNotificationServiceFilesChanged (const Array<File>& changedFiles) = 0;
+    };
+
+
+    //=========================================================================
+    enum class Changes
+    {
+        /** Any change to the file, or to the directory's children. */
+        any,
+
+        /**
+         * Only children of the directory being created, deleted, or renamed,
+         * or the directory itself being deleted or moved; writes to children
+         * are not reported. The listener is given the directory itself, once
+         * per batch, rather than the children that changed.
+         */
+        entries,
+    };
+
+
+    //=========================================================================
+    FileNotificationService();
+    ~FileNotificationService();
+
+
+    /**
+     * Report changes to the given file or directory to the listener. This does
+     * nothing if the listener is already subscribed to it. The file is not
+     * looked at on the calling thread.
+     */
+    void subscribe (Listener* listener, const File& fileOrDirectory, Changes changes=Changes::any);
+
+
+    /**
+     * Stop reporting changes to the given file or directory to the listener.
+     */
+    void unsubscribe (Listener* listener, const File& fileOrDirectory);
+
+
+    /**
+     * Remove every subscription the listener has.
+     */
+    void unsubscribeAll (Listener* listener);
+
+
+private:
+
+
+    //=========================================================================
+    struct Subscription
+    {
+        Listener* listener = nullptr;
+        File target;
+        File watched;
+        bool resolved = false;
+        bool isDirectory = false;
+        Changes changes = Changes::any;
+        Time modified;
+    };
+
+    struct Change
+    {
+        bool entries = false;
+        bool exact = false;
+    };
+
+    struct Watch
+    {
+        int descriptor = -1;
+        bool lost = false;
+        std::map<String, int> files;
+    };
+
+
+    //=========================================================================
+    void run() override;
+    void handleAsyncUpdate() override;
+    void resolveSubscriptions();
+    void updateWatches();
+    bool openWatch (const String& path, Watch& watch);
+    void closeWatch (Watch& watch);
+    bool hasUnopenedWatches() const;
+    bool waitForEvents();
+    void pollSubscriptions();
+    void wakeThread();
+    void drainWakeupPipe();
+    void post (const File& changed, bool entriesChanged, bool exact=false);
+    bool isSubscribed (Listener* listener) const;
+    static bool matches (const Subscription& subscription, const File& changed, const Change& change);
+
+#if JUCE_MAC
+    void reopenFiles (Watch& watch);
+    int openVnode (const String& path);
+    void closeVnode (int descriptor);
+    static bool refersTo (int descriptor, const String& path);
+#endif
+
+    /**
+     * The lock guards subscriptions and pending, and is never held during
+     * filesystem calls. Watches and descriptors belong to the background
+     * thread alone.
+     */
+    CriticalSection lock;
+    std::vector<Subscription> subscriptions;
+    std::map<String, Change> pending;
+    std::map<String, Watch> watches;
+    std::map<int, String> pathsByDescriptor;
+    int inotifyDescriptor = -1;
+    int kqueueDescriptor = -1;
+    int wakeupPipe[2] = { -1, -1 };
+    WaitableEvent wakeup;
+};
+
+
+
+
+//=============================================================================
+/**
+ * Reports a file once it has stopped changing: when its size and modification
+ * time have stayed the same for the settle interval. This is meant to sit
+ * between a change notification and a reload, so that a file still being
+ * written (e.g. a checkpoint) is not read half-finished. The timer only runs
+ * while a change is waiting to settle.
+ */
+class FileSettleTimer : private Timer
+{
+public:
+
+
+    //=========================================================================
+    void setCallback (std::function<void(File)> callbackToInvoke);
+
+
+    /**
+     * Set how long, in milliseconds, a file must be unchanged to be settled.
+     */
+    void setSettleInterval (int milliseconds);
+
+
+    /**
+     * Start (or restart) waiting for the given file to settle. A file that
+     * was waiting already is replaced.
+     */
+    void fileChanged (const File& changedFile);
+
+
+    /**
+     * Stop waiting, without calling back.
+     */
+    void cancel();
+
+
+private:
+
+
+    //=========================================================================
+    void timerCallback() override;
+
+    File file;
+    int64 size = 0;
+    Time modified;
+    double lastChange = 0.0;
+    int settleInterval = 500;
+    std::function<void(File)> callback = nullptr;
+};
@@ -0,0 +1,120 @@
+#include "FileStampCache.hpp"
+
+
+
+
+//=============================================================================
+FileStampCache::FileStampCache() : Thread ("FileStampCache")
+{
+    startThread();
+}
+
+FileStampCache::~FileStampCache()
+{
+    signalThreadShouldExit();
+    requestAdded.signal();
+    stopThread (4000);
+    fileNotifications->unsubscribeAll (this);
+}
+
+FileStampCache::Kind FileStampCache::lookup (const String& path, std::string& stamp)
+{
+    const ScopedLock sl (lock);
+    auto entry = entries.find (path);
+
+    if (entry == entries.end())
+    {
+        entry = entries.emplace (path, Entry()).first;
+        queued.insert (path);
+        requestAdded.signal();
+        fileNotifications->subscribe (this, File (path));
+    }
+    entry->second.lastUsed = ++useCounter;
+    stamp = entry->second.stamp;
+
+    auto kind = entry->second.kind;
+    evictLeastRecentlyUsed();
+    return kind;
+}
+
+
+
+
+//=============================================================================
+void FileStampCache::run()
+{
+    while (! threadShouldExit())
+    {
+        requestAdded.wait (-1);
+
+        auto paths = std::set<String>();
+        {
+            const ScopedLock sl (lock);
+            std::swap (paths, queued);
+        }
+
+        for (const auto& path : paths)
+        {
+            if (threadShouldExit())
+                return;
+
+            auto file = File (path);
+            auto kind = Kind::missing;
+            auto stamp = std::string();
+
+            if (file.isDirectory())
+            {
+                kind = Kind::directory;
+            }
+            else if (file.existsAsFile())
+            {
+                kind = Kind::file;
+                stamp = std::to_string (file.getSize()) + ":" + std::to_string (file.getLastModificationTime().toMilliseconds());
+            }
+
+            // A path queued again while it was being looked at has changed
+            // since, so it is left unknown for the next pass.
+            // ----------------------------------------------------------------
+            const ScopedLock sl (lock);
+            auto entry = entries.find (path);
+
+            if (entry != entries.end() && ! queued.count (path))
+            {
+                entry->second.kind = kind;
+                entry->second.stamp = stamp;
+            }
+        }
+    }
+}
+
+void FileStampCache::fileNotificationServiceFilesChanged (const Array<File>& changedFiles)
+{
+    const ScopedLock sl (lock);
+
+    for (const auto& file : changedFiles)
+    {
+        auto entry = entries.find (file.getFullPathName());
+
+        if (entry != entries.end())
+        {
+            entry->second.kind = Kind::unknown;
+            entry->second.stamp.clear();
+            queued.insert (entry->first);
+        }
+    }
+    requestAdded.signal();
+}
+
+void FileStampCache::evictLeastRecentlyUsed()
+{
+    while (int (entries.size()) > maximumPaths)
+    {
+        auto oldest = std::min_element (entries.begin(), entries.end(), [] (const auto& a, const auto& b)
+        {
+            return a.second.lastUsed < b.second.lastUsed;
+        });
+        fileNotifications->unsubscribe (this, File (oldest->first));
+        queued.erase (oldest->first);
+        entries.erase (oldest);
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "JuceHeader.h"
+#include "FileNotificationService.hpp"
+
+
+
+
+//=============================================================================
+/**
+ * A process-wide table of what is on disk at the paths that rule values name:
+ * nothing, a directory, or a file with a given size and modification time.
+ * Paths are looked at on a background thread, and looked at again whenever
+ * the file notification service reports a change, so a lookup never touches
+ * the filesystem. A path that has not been looked at yet (or has changed
+ * since) is reported as unknown. The least recently used paths are dropped
+ * once more than a hundred or so are known.
+ *
+ * Obtain the cache through a SharedResourcePointer<FileStampCache>, and keep
+ * one alive for as long as stamps are wanted. Lookups must be made on the
+ * message thread.
+ */
+class FileStampCache : private Thread, private FileNotificationService::Listener
+{
+public:
+
+
+    //=========================================================================
+    enum class Kind
+    {
+        unknown,
+        missing,
+        file,
+        directory,
+    };
+
+
+    //=========================================================================
+    FileStampCache();
+    ~FileStampCache();
+
+
+    /**
+     * Return what is at the given path. For a file, the stamp is set to a
+     * string made of its size and modification time. A path that is not
+     * known is queued to be looked at, and unknown is returned.
+     */
+    Kind lookup (const String& path, std::string& stamp);
+
+
+private:
+
+
+    //=========================================================================
+    struct Entry
+    {
+        Kind kind = Kind::unknown;
+        std::string stamp;
+        uint64 lastUsed = 0;
+    };
+
+
+    //=========================================================================
+    void run() override;
+    void fileNotificationServiceFilesChanged (const Array<File>& changedFiles) override;
+    void evictLeastRecentlyUsed();
+
+    CriticalSection lock;
+    WaitableEvent requestAdded;
+    std::map<String, Entry> entries;
+    std::set<String> queued;
+    uint64 useCounter = 0;
+    int maximumPaths = 128;
+    SharedResourcePointer<FileNotificationService> fileNotifications;
+};
@@ -0,0 +1,340 @@
+#include "HDF5MetadataIndex.hpp"
+
+
+
+
+//=============================================================================
+HDF5MetadataIndex::HDF5MetadataIndex()
+{
+    load();
+}
+
+HDF5MetadataIndex::~HDF5MetadataIndex()
+{
+    stopTimer();
+    collectProbes (true);
+    save();
+}
+
+void HDF5MetadataIndex::addListener (Listener* listener)
+{
+    listeners.add (listener);
+}
+
+void HDF5MetadataIndex::removeListener (Listener* listener)
+{
+    listeners.remove (listener);
+}
+
+Array<HDF5MetadataIndex::Location> HDF5MetadataIndex::describe (const File& file, const StringArray& locations)
+{
+    auto path = file.getFullPathName();
+    auto size = file.getSize();
+    auto modified = file.getLastModificationTime().toMilliseconds();
+    auto result = Array<Location>();
+    auto missing = false;
+    auto isStale = false;
+
+    // Each location is answered from the file's entry, if it knows about it.
+    // Otherwise the location is reported as pending, and the file is probed
+    // in the background. If the file has changed since the entry was made,
+    // the entry is still used, but the file is re-probed in the background;
+    // either way, listeners are told when the probe lands.
+    // ------------------------------------------------------------------------
+    {
+        const ScopedLock sl (lock);
+        auto entry = entries.find (path);
+        auto found = entry != entries.end();
+
+        if (found)
+            entry->second.lastUsed = Time::currentTimeMillis();
+
+        isStale = found && (entry->second.size != size || entry->second.modified != modified);
+
+        for (const auto& location : locations)
+        {
+            if (found && ! entry->second.isHDF5)
+            {
+                result.add (Location());
+            }
+            else if (found && entry->second.locations.count (location))
+            {
+                result.add (entry->second.locations.at (location));
+            }
+            else
+            {
+                auto pending = Location();
+                pending.pending = true;
+                result.add (pending);
+                missing = true;
+            }
+        }
+    }
+
+    if (missing || isStale)
+        probeInBackground (path, locations, size, modified);
+
+    return result;
+}
+
+void HDF5MetadataIndex::save()
+{
+    auto root = var (new DynamicObject);
+    {
+        const ScopedLock sl (lock);
+        evictLeastRecentlyUsed (maximumFiles);
+
+        for (const auto& item : entries)
+        {
+            auto entry = var (new DynamicObject);
+            auto locations = var (new DynamicObject);
+
+            for (const auto& loc : item.second.locations)
+            {
+                auto location = var (new DynamicObject);
+                auto shape = Array<var>();
+
+                for (auto extent : loc.second.shape)
+                    shape.add (extent);
+
+                location.getDynamicObject()->setProperty ("exists", loc.second.exists);
+                location.getDynamicObject()->setProperty ("group", loc.second.isGroup);
+                location.getDynamicObject()->setProperty ("rank", loc.second.rank);
+                location.getDynamicObject()->setProperty ("shape", shape);
+                location.getDynamicObject()->setProperty ("dtype", loc.second.dtype);
+                locations.getDynamicObject()->setProperty (loc.first, location);
+            }
+            entry.getDynamicObject()->setProperty ("size", item.second.size);
+            entry.getDynamicObject()->setProperty ("modified", item.second.modified);
+            entry.getDynamicObject()->setProperty ("hdf5", item.second.isHDF5);
+            entry.getDynamicObject()->setProperty ("used", item.second.lastUsed);
+            entry.getDynamicObject()->setProperty ("locations", locations);
+            root.getDynamicObject()->setProperty (item.first, entry);
+        }
+    }
+
+    auto file = getIndexFile();
+    file.getParentDirectory().createDirectory();
+    file.replaceWithText (JSON::toString (root, true));
+}
+
+int HDF5MetadataIndex::getNumFiles() const
+{
+    const ScopedLock sl (lock);
+    return int (entries.size());
+}
+
+
+
+
+//=============================================================================
+HDF5MetadataIndex::Entry HDF5MetadataIndex::probe (h5::File& h5f, const StringArray& locations)
+{
+    auto entry = Entry();
+    entry.isHDF5 = true;
+
+    for (const auto& name : locations)
+    {
+        auto location = Location();
+        auto loc = name.toStdString();
+
+        try {
+            h5f.open_group (loc);
+            location.exists = true;
+            location.isGroup = true;
+        }
+        catch (const std::exception&)
+        {
+            try {
+                auto h5d = h5f.open_dataset (loc);
+                auto space = h5d.get_space();
+
+                location.exists = true;
+                location.rank = int (space.rank());
+                location.dtype = "other";
+
+                if      (h5d.get_type() == h5::native_type<int>())         location.dtype = "int";
+                else if (h5d.get_type() == h5::native_type<double>())      location.dtype = "double";
+                else if (h5d.get_type() == h5::native_type<float>())       location.dtype = "float";
+                else if (h5d.get_type() == h5::native_type<std::string>()) location.dtype = "string";
+
+                for (auto extent : space.extent())
+                    location.shape.add (int64 (extent));
+            }
+            catch (const std::exception&)
+            {
+            }
+        }
+        entry.locations[name] = location;
+    }
+    return entry;
+}
+
+void HDF5MetadataIndex::timerCallback()
+{
+    auto finished = collectProbes (false);
+
+    if (! finished.isEmpty())
+    {
+        listeners.call (&Listener::hdf5MetadataIndexChanged, finished);
+    }
+
+    const ScopedLock sl (lock);
+
+    if (probes.empty())
+    {
+        stopTimer();
+    }
+}
+
+void HDF5MetadataIndex::probeInBackground (const String& path, const StringArray& locations, int64 size, int64 modified)
+{
+    const ScopedLock sl (lock);
+
+    if (probes.count (path))
+    {
+        return;
+    }
+
+    // The timer looks for finished probes while any are running, so that
+    // a file that can't be opened at all (and so never reaches the request
+    // function) is noticed too.
+    // ------------------------------------------------------------------------
+    auto& pending = probes[path];
+    pending.size = size;
+    pending.modified = modified;
+    pending.result = service->submit<Entry> (path.toStdString(), HDF5Service::Priority::metadata, [locations] (h5::File& h5f)
+    {
+        return probe (h5f, locations);
+    });
+    startTimer (50);
+}
+
+Array<File> HDF5MetadataIndex::collectProbes (bool waitForAll)
+{
+    const ScopedLock sl (lock);
+    auto finished = Array<File>();
+
+    for (auto item = probes.begin(); item != probes.end();)
+    {
+        if (! waitForAll && item->second.result.wait_for (std::chrono::seconds (0)) != std::future_status::ready)
+        {
+            ++item;
+            continue;
+        }
+
+        // A file that can't be opened as HDF5 is recorded as such.
+        // --------------------------------------------------------------------
+        auto fresh = Entry();
+
+        try {
+            fresh = item->second.result.get();
+        }
+        catch (const std::exception&)
+        {
+            fresh.isHDF5 = false;
+        }
+        fresh.size = item->second.size;
+        fresh.modified = item->second.modified;
+        merge (item->first, fresh);
+        finished.add (File (item->first));
+        item = probes.erase (item);
+    }
+    return finished;
+}
+
+void HDF5MetadataIndex::merge (const String& path, const Entry& fresh)
+{
+    auto& entry = entries[path];
+
+    if (entry.size != fresh.size || entry.modified != fresh.modified || entry.isHDF5 != fresh.isHDF5)
+        entry = fresh;
+    else
+        for (const auto& item : fresh.locations)
+            entry.locations[item.first] = item.second;
+
+    entry.lastUsed = Time::currentTimeMillis();
+
+    // Entries are evicted in batches, rather than one per new file, once
+    // there are an eighth more than the maximum.
+    // ------------------------------------------------------------------------
+    if (int (entries.size()) > maximumFiles + maximumFiles / 8)
+        evictLeastRecentlyUsed (maximumFiles);
+}
+
+void HDF5MetadataIndex::evictLeastRecentlyUsed (int numToKeep)
+{
+    if (int (entries.size()) <= numToKeep)
+    {
+        return;
+    }
+    auto used = std::vector<int64>();
+
+    for (const auto& item : entries)
+        used.push_back (item.second.lastUsed);
+
+    std::nth_element (used.begin(), used.end() - numToKeep, used.end());
+    auto threshold = *(used.end() - numToKeep);
+
+    // Entries used before the threshold go first, then as many of those used
+    // at the threshold as needed.
+    // ------------------------------------------------------------------------
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (auto item = entries.begin(); item != entries.end() && int (entries.size()) > numToKeep;)
+        {
+            if (item->second.lastUsed < threshold + pass)
+                item = entries.erase (item);
+            else
+                ++item;
+        }
+    }
+}
+
+void HDF5MetadataIndex::load()
+{
+    auto root = JSON::parse (getIndexFile());
+
+    if (auto obj = root.getDynamicObject())
+    {
+        for (const auto& item : obj->getProperties())
+        {
+            auto path = item.name.toString();
+
+            if (! File (path).existsAsFile())
+                continue;
+
+            auto entry = Entry();
+            entry.size     = item.value["size"];
+            entry.modified = item.value["modified"];
+            entry.isHDF5   = item.value["hdf5"];
+            entry.lastUsed = item.value["used"];
+
+            if (auto locations = item.value["locations"].getDynamicObject())
+            {
+                for (const auto& loc : locations->getProperties())
+                {
+                    auto location = Location();
+                    location.exists  = loc.value["exists"];
+                    location.isGroup = loc.value["group"];
+                    location.rank    = loc.value["rank"];
+                    location.dtype   = loc.value["dtype"];
+
+                    if (auto shape = loc.value["shape"].getArray())
+                        for (const auto& extent : *shape)
+                            location.shape.add (int64 (extent));
+
+                    entry.locations[loc.name.toString()] = location;
+                }
+            }
+            entries[path] = entry;
+        }
+    }
+}
+
+File HDF5MetadataIndex::getIndexFile()
+{
+    return File::getSpecialLocation (File::userApplicationDataDirectory)
+    .getChildFile ("CounterPlot")
+    .getChildFile ("hdf5-index.json");
+}
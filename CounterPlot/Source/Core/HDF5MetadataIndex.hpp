@@ -0,0 +1,122 @@
+#pragma once
+#include "JuceHeader.h"
+#include "HDF5Service.hpp"
+
+
+
+
+//=============================================================================
+/**
+ * A process-wide index of HDF5 file metadata: for each file, keyed by its
+ * path, size, and modification time, whether it is an HDF5 file at all, and
+ * for each location (group or dataset path) that has been asked about, what
+ * is there: a group, or a dataset with its rank, shape, and data type.
+ *
+ * Lookups are answered from the index, and never wait for a file to be
+ * read. A file that is not in the index is probed in the background, through
+ * the HDF5 service at metadata priority, and reported as pending until the
+ * probe finishes; listeners are then told, so they can ask again. A file that
+ * has changed since it was indexed is answered from the stale entry, and
+ * re-probed in the background. The index is saved to the user's application
+ * data directory, so it survives restarts. Files that no longer exist are
+ * dropped when it is loaded, and only the most recently used few thousand
+ * files are kept.
+ *
+ * Obtain the index through a SharedResourcePointer<HDF5MetadataIndex>.
+ * Listeners are called on the message thread.
+ */
+class HDF5MetadataIndex : private Timer
+{
+public:
+
+
+    //=========================================================================
+    struct Location
+    {
+        bool exists = false;
+        bool isGroup = false;
+        bool pending = false;
+        int rank = -1;
+        Array<int64> shape;
+        String dtype;
+    };
+
+
+    //=========================================================================
+    class Listener
+    {
+    public:
+        virtual ~Listener() {}
+
+        /** Called when probes of the given files have finished. */
+        virtual void hdf5MetadataIndexChanged (const Array<File>& files) = 0;
+    };
+
+
+    //=========================================================================
+    HDF5MetadataIndex();
+    ~HDF5MetadataIndex();
+    void addListener (Listener* listener);
+    void removeListener (Listener* listener);
+
+
+    /**
+     * Return metadata for the given locations in the given file. The result
+     * has one element per location. If the file is not HDF5 (or does not
+     * exist), every location is reported as not existing. Locations that are
+     * not indexed yet are reported as pending (and not existing).
+     */
+    Array<Location> describe (const File& file, const StringArray& locations);
+
+
+    /**
+     * Write the index to disk now, rather than waiting for it to be destroyed.
+     */
+    void save();
+
+
+    /**
+     * Return the number of files currently in the index.
+     */
+    int getNumFiles() const;
+
+
+private:
+
+
+    //=========================================================================
+    struct Entry
+    {
+        int64 size = 0;
+        int64 modified = 0;
+        bool isHDF5 = false;
+        int64 lastUsed = 0;
+        std::map<String, Location> locations;
+    };
+
+
+    struct Probe
+    {
+        std::future<Entry> result;
+        int64 size = 0;
+        int64 modified = 0;
+    };
+
+
+    //=========================================================================
+    void timerCallback() override;
+    static Entry probe (h5::File& h5f, const StringArray& locations);
+    void probeInBackground (const String& path, const StringArray& locations, int64 size, int64 modified);
+    Array<File> collectProbes (bool waitForAll);
+    void merge (const String& path, const Entry& fresh);
+    void evictLeastRecentlyUsed (int numToKeep);
+    void load();
+    static File getIndexFile();
+
+    static const int maximumFiles = 4096;
+    CriticalSection lock;
+    std::map<String, Entry> entries;
+    std::map<String, Probe> probes;
+    ListenerList<Listener> listeners;
+    SharedResourcePointer<HDF5Service> service;
+};
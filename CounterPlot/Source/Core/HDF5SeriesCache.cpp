@@ -0,0 +1,130 @@
+#include "HDF5SeriesCache.hpp"
+
+
+
+
+//=============================================================================
+HDF5SeriesCache::HDF5SeriesCache()
+{
+    load();
+}
+
+HDF5SeriesCache::~HDF5SeriesCache()
+{
+    if (dirty)
+    {
+        save();
+    }
+}
+
+bool HDF5SeriesCache::lookup (const File& file, const String& dataset, double& value) const
+{
+    const ScopedLock sl (lock);
+    auto entry = entries.find (file.getFullPathName());
+
+    if (entry == entries.end()
+        || entry->second.size != file.getSize()
+        || entry->second.modified != file.getLastModificationTime().toMilliseconds()
+        || entry->second.values.count (dataset) == 0)
+    {
+        return false;
+    }
+    value = entry->second.values.at (dataset);
+    return true;
+}
+
+void HDF5SeriesCache::store (const File& file, const String& dataset, double value)
+{
+    auto size = file.getSize();
+    auto modified = file.getLastModificationTime().toMilliseconds();
+
+    const ScopedLock sl (lock);
+    auto& entry = entries[file.getFullPathName()];
+
+    if (entry.size != size || entry.modified != modified)
+    {
+        entry = Entry();
+        entry.size = size;
+        entry.modified = modified;
+    }
+    entry.values[dataset] = value;
+    dirty = true;
+}
+
+void HDF5SeriesCache::saveIfNeeded()
+{
+    {
+        const ScopedLock sl (lock);
+
+        if (! dirty || Time::getMillisecondCounter() - lastSaved < saveInterval)
+        {
+            return;
+        }
+    }
+    save();
+}
+
+void HDF5SeriesCache::save()
+{
+    auto root = var (new DynamicObject);
+    {
+        const ScopedLock sl (lock);
+        dirty = false;
+        lastSaved = Time::getMillisecondCounter();
+
+        for (const auto& item : entries)
+        {
+            auto entry = var (new DynamicObject);
+            auto values = var (new DynamicObject);
+
+            for (const auto& value : item.second.values)
+                values.getDynamicObject()->setProperty (value.first, value.second);
+
+            entry.getDynamicObject()->setProperty ("size", item.second.size);
+            entry.getDynamicObject()->setProperty ("modified", item.second.modified);
+            entry.getDynamicObject()->setProperty ("values", values);
+            root.getDynamicObject()->setProperty (item.first, entry);
+        }
+    }
+
+    auto file = getCacheFile();
+    file.getParentDirectory().createDirectory();
+    file.replaceWithText (JSON::toString (root, true));
+}
+
+
+
+
+//=============================================================================
+void HDF5SeriesCache::load()
+{
+    auto root = JSON::parse (getCacheFile());
+
+    if (auto obj = root.getDynamicObject())
+    {
+        for (const auto& item : obj->getProperties())
+        {
+            auto path = item.name.toString();
+
+            if (! File (path).existsAsFile())
+                continue;
+
+            auto entry = Entry();
+            entry.size     = item.value["size"];
+            entry.modified = item.value["modified"];
+
+            if (auto values = item.value["values"].getDynamicObject())
+                for (const auto& value : values->getProperties())
+                    entry.values[value.name.toString()] = value.value;
+
+            entries[path] = entry;
+        }
+    }
+}
+
+File HDF5SeriesCache::getCacheFile()
+{
+    return File::getSpecialLocation (File::userApplicationDataDirectory)
+    .getChildFile ("CounterPlot")
+    .getChildFile ("hdf5-series.json");
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "JuceHeader.h"
+
+
+
+
+//=============================================================================
+/**
+ * A process-wide cache of scalar values read from HDF5 files, such as the
+ * simulation time of a checkpoint. Values are keyed by file path and dataset
+ * name, and are only valid while the file's size and modification time are
+ * unchanged. The cache is saved to the user's application data directory, so
+ * a series over many checkpoints only reads the files that are new (or have
+ * changed) since the last time it was loaded, even across restarts. New
+ * values are written out at most every few seconds, and when the cache is
+ * destroyed.
+ *
+ * Obtain the cache through a SharedResourcePointer<HDF5SeriesCache>.
+ */
+class HDF5SeriesCache
+{
+public:
+
+
+    //=========================================================================
+    HDF5SeriesCache();
+    ~HDF5SeriesCache();
+
+
+    /**
+     * Look for the value of the given dataset in the given file. Return false
+     * if it has not been cached, or the file has changed since it was.
+     */
+    bool lookup (const File& file, const String& dataset, double& value) const;
+
+
+    /**
+     * Record the value of the given dataset in the given file.
+     */
+    void store (const File& file, const String& dataset, double value);
+
+
+    /**
+     * Write the cache to disk now, rather than waiting for it to be destroyed.
+     */
+    void save();
+
+
+    /**
+     * Write the cache to disk if values have been stored since it was last
+     * written, and it was not written in the last few seconds.
+     */
+    void saveIfNeeded();
+
+
+private:
+
+
+    //=========================================================================
+    struct Entry
+    {
+        int64 size = 0;
+        int64 modified = 0;
+        std::map<String, double> values;
+    };
+
+
+    //=========================================================================
+    void load();
+    static File getCacheFile();
+
+    static const uint32 saveInterval = 5000;
+    CriticalSection lock;
+    std::map<String, Entry> entries;
+    bool dirty = false;
+    uint32 lastSaved = 0;
+};
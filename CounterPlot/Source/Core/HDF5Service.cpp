@@ -0,0 +1,144 @@
+#include "HDF5Service.hpp"
+
+
+
+
+//=============================================================================
+HDF5Service::HDF5Service() : Thread ("HDF5Service")
+{
+    startThread();
+}
+
+HDF5Service::~HDF5Service()
+{
+    signalThreadShouldExit();
+    requestAdded.signal();
+    stopThread (4000);
+}
+
+void HDF5Service::setMaximumOpenFiles (int newMaximumOpenFiles)
+{
+    maximumOpenFiles = jmax (1, newMaximumOpenFiles);
+}
+
+void HDF5Service::closeAllFiles()
+{
+    shouldCloseAllFiles = true;
+    requestAdded.signal();
+}
+
+
+
+
+//=============================================================================
+void HDF5Service::run()
+{
+    while (! threadShouldExit())
+    {
+        auto request = Request();
+
+        if (shouldCloseAllFiles.exchange (false))
+        {
+            handles.clear();
+        }
+
+        if (! takeNext (request))
+        {
+            requestAdded.wait (500);
+            continue;
+        }
+
+        if (request.cancelled && request.cancelled())
+        {
+            request.run (nullptr, nullptr);
+            continue;
+        }
+
+        try {
+            auto file = open (request.path);
+            request.run (file.get(), nullptr);
+        }
+        catch (...)
+        {
+            request.run (nullptr, std::current_exception());
+        }
+    }
+
+    // Requests still queued at shutdown are failed rather than abandoned, so
+    // that nobody waits forever on their futures.
+    // ------------------------------------------------------------------------
+    auto request = Request();
+    auto error = std::make_exception_ptr (std::runtime_error ("HDF5 service was shut down"));
+
+    while (takeNext (request))
+        request.run (nullptr, error);
+
+    handles.clear();
+}
+
+void HDF5Service::add (Request request)
+{
+    {
+        const ScopedLock lock (queueLock);
+        request.order = nextOrder++;
+        queue.push_back (request);
+    }
+    requestAdded.signal();
+}
+
+bool HDF5Service::takeNext (Request& request)
+{
+    const ScopedLock lock (queueLock);
+
+    if (queue.empty())
+    {
+        return false;
+    }
+
+    auto next = queue.begin();
+
+    for (auto entry = queue.begin(); entry != queue.end(); ++entry)
+        if (entry->priority > next->priority || (entry->priority == next->priority && entry->order < next->order))
+            next = entry;
+
+    request = *next;
+    queue.erase (next);
+    return true;
+}
+
+std::shared_ptr<h5::File> HDF5Service::open (const std::string& path)
+{
+    auto file = File (path);
+    auto size = file.getSize();
+    auto modified = file.getLastModificationTime();
+
+
+    // A cached handle is only reused if the file on disk has not changed
+    // since it was opened; otherwise it's closed and the file re-opened.
+    // ------------------------------------------------------------------------
+    for (auto handle = handles.begin(); handle != handles.end(); ++handle)
+    {
+        if (handle->path == path)
+        {
+            if (handle->size == size && handle->modified == modified)
+            {
+                handles.splice (handles.begin(), handles, handle);
+                return handles.front().file;
+            }
+            handles.erase (handle);
+            break;
+        }
+    }
+
+    if (! h5::File::exists (path))
+    {
+        throw std::runtime_error ("not an HDF5 file: " + path);
+    }
+
+    handles.push_front ({ path, std::make_shared<h5::File> (path, "r"), size, modified });
+
+    while (int (handles.size()) > maximumOpenFiles)
+        handles.pop_back();
+
+    return handles.front().file;
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <future>
+#include "JuceHeader.h"
+
+
+
+
+//=============================================================================
+/**
+ * A process-wide service through which all HDF5 access is made. The HDF5
+ * library is not thread-safe, so requests are run one at a time, on the
+ * service's own thread, in place of a global lock. Callers submit a request
+ * (a function of an open h5::File) and get a future for its result, which
+ * they can wait on while polling their own bailout condition.
+ *
+ * Requests are queued by priority: metadata probes (e.g. checking that a
+ * file has some dataset) jump ahead of any bulk reads that are waiting. A
+ * request that is already running is not interrupted. Files are kept open
+ * in a small least-recently-used cache of handles, which are re-opened if
+ * the file's size or modification time has changed.
+ *
+ * Obtain the service through a SharedResourcePointer<HDF5Service>. It lives
+ * for as long as any such pointer does.
+ */
+class HDF5Service : private Thread
+{
+public:
+
+
+    //=========================================================================
+    enum class Priority
+    {
+        bulk     = 0,
+        metadata = 1,
+    };
+
+
+    //=========================================================================
+    HDF5Service();
+    ~HDF5Service();
+
+
+    /**
+     * Queue a request to be run against the HDF5 file at the given path. If
+     * the file cannot be opened, or the request throws, the exception is
+     * delivered through the future. If the cancelled callback is given and
+     * returns true by the time the request reaches the front of the queue,
+     * the request is dropped and the future's result is default-constructed.
+     */
+    template<typename Result>
+    std::future<Result> submit (const std::string& path,
+                                Priority priority,
+                                std::function<Result (h5::File&)> request,
+                                std::function<bool()> cancelled=nullptr)
+    {
+        auto promise = std::make_shared<std::promise<Result>>();
+        auto future = promise->get_future();
+        auto entry = Request();
+
+        entry.path = path;
+        entry.priority = priority;
+        entry.cancelled = cancelled;
+        entry.run = [promise, request] (h5::File* file, std::exception_ptr error)
+        {
+            if (error)
+                return promise->set_exception (error);
+
+            if (file == nullptr)
+                return promise->set_value (Result());
+
+            try {
+                promise->set_value (request (*file));
+            }
+            catch (...)
+            {
+                promise->set_exception (std::current_exception());
+            }
+        };
+        add (entry);
+        return future;
+    }
+
+
+    /**
+     * Wait for a future returned by submit, checking the bailout callback
+     * periodically. If the bailout returns true, a default-constructed
+     * result is returned without waiting any further.
+     */
+    template<typename Result>
+    static Result waitFor (std::future<Result>& future, std::function<bool()> bailout=nullptr)
+    {
+        while (future.wait_for (std::chrono::milliseconds (20)) != std::future_status::ready)
+        {
+            if (bailout && bailout())
+            {
+                return Result();
+            }
+        }
+        return future.get();
+    }
+
+
+    /**
+     * Set the maximum number of files kept open between requests.
+     */
+    void setMaximumOpenFiles (int maximumOpenFiles);
+
+
+    /**
+     * Close all cached file handles. Handles are closed on the service thread,
+     * after any request that is running has finished.
+     */
+    void closeAllFiles();
+
+
+private:
+
+
+    //=========================================================================
+    struct Request
+    {
+        std::string path;
+        Priority priority = Priority::bulk;
+        uint64 order = 0;
+        std::function<bool()> cancelled;
+        std::function<void(h5::File*, std::exception_ptr)> run;
+    };
+
+    struct Handle
+    {
+        std::string path;
+        std::shared_ptr<h5::File> file;
+        int64 size = 0;
+        Time modified;
+    };
+
+
+    //=========================================================================
+    void run() override;
+    void add (Request request);
+    bool takeNext (Request& request);
+    std::shared_ptr<h5::File> open (const std::string& path);
+
+    CriticalSection queueLock;
+    WaitableEvent requestAdded;
+    std::vector<Request> queue;
+    uint64 nextOrder = 0;
+    std::list<Handle> handles;
+    std::atomic<int> maximumOpenFiles { 16 };
+    std::atomic<bool> shouldCloseAllFiles { false };
+};
@@ -0,0 +1,124 @@
+#include "NumpyLoader.hpp"
+
+
+
+
+//=============================================================================
+NumpyLoader::NumpyLoader (const File& file)
+{
+    mapped = std::make_unique<MemoryMappedFile> (file, MemoryMappedFile::readOnly);
+
+    if (mapped->getData() == nullptr)
+    {
+        throw std::runtime_error ("could not open " + file.getFileName().toStdString());
+    }
+    begin = static_cast<const char*> (mapped->getData());
+    end = begin + mapped->getSize();
+    parseHeader();
+}
+
+NumpyLoader::NumpyLoader (const File& archive, const String& member)
+{
+    ZipFile zip (archive);
+    auto index = zip.getIndexOfFileName (member);
+
+    if (index == -1)
+        index = zip.getIndexOfFileName (member + ".npy");
+
+    if (index == -1)
+    {
+        throw std::runtime_error ("no member " + member.toStdString() + " in " + archive.getFileName().toStdString());
+    }
+
+    auto stream = std::unique_ptr<InputStream> (zip.createStreamForEntry (index));
+
+    if (stream == nullptr)
+    {
+        throw std::runtime_error ("could not read member " + member.toStdString());
+    }
+    stream->readIntoMemoryBlock (extracted);
+    begin = static_cast<const char*> (extracted.getData());
+    end = begin + extracted.getSize();
+    parseHeader();
+}
+
+
+
+
+//=============================================================================
+void NumpyLoader::parseHeader()
+{
+    // The format is the magic string \x93NUMPY, a major and minor version
+    // byte, and a little-endian header length: two bytes in version 1, four
+    // in versions 2 and 3. The header is a Python dict literal, e.g.
+    // {'descr': '<f8', 'fortran_order': False, 'shape': (3, 4), }
+    // ------------------------------------------------------------------------
+    auto bytes = reinterpret_cast<const uint8*> (begin);
+
+    if (end - begin < 10 || std::memcmp (begin, "\x93NUMPY", 6) != 0)
+    {
+        throw std::runtime_error ("not a .npy file");
+    }
+
+    auto major = bytes[6];
+    auto headerStart = major == 1 ? 10 : 12;
+    auto headerLength = major == 1
+    ? int (ByteOrder::littleEndianShort (bytes + 8))
+    : int (ByteOrder::littleEndianInt (bytes + 8));
+
+    if (major < 1 || major > 3 || end - begin < headerStart + headerLength)
+    {
+        throw std::runtime_error ("unsupported or truncated .npy header");
+    }
+
+    auto header = String (begin + headerStart, size_t (headerLength));
+    auto value = [&header] (const String& key)
+    {
+        return header.fromFirstOccurrenceOf ("'" + key + "':", false, false).trimStart();
+    };
+
+    descr = value ("descr").fromFirstOccurrenceOf ("'", false, false).upToFirstOccurrenceOf ("'", false, false).toStdString();
+    auto fortranOrder = value ("fortran_order").startsWith ("True");
+    auto shapeString = value ("shape").fromFirstOccurrenceOf ("(", false, false).upToFirstOccurrenceOf (")", false, false);
+
+    for (const auto& extent : StringArray::fromTokens (shapeString, ",", ""))
+        if (extent.trim().isNotEmpty())
+            shape.push_back (extent.trim().getIntValue());
+
+    if (descr.size() < 3)
+    {
+        throw std::runtime_error ("bad .npy dtype '" + descr + "'");
+    }
+
+    auto order = descr[0];
+    kind = descr[1] == 'b' ? 'u' : descr[1];
+    itemSize = std::atoi (descr.data() + 2);
+
+    if (! (kind == 'f' && (itemSize == 4 || itemSize == 8))
+        && ! ((kind == 'i' || kind == 'u') && (itemSize == 1 || itemSize == 2 || itemSize == 4 || itemSize == 8)))
+    {
+        throw std::runtime_error ("unsupported .npy dtype '" + descr + "'");
+    }
+    swapBytes = itemSize > 1 && ((order == '<' && ByteOrder::isBigEndian()) || (order == '>' && ! ByteOrder::isBigEndian()));
+
+
+    // Strides are in elements; a Fortran-ordered array is read through
+    // strides that run from the first axis rather than the last.
+    // ------------------------------------------------------------------------
+    strides.resize (shape.size());
+
+    for (std::size_t n = 0; n < shape.size(); ++n)
+    {
+        auto axis = fortranOrder ? n : shape.size() - 1 - n;
+        strides[axis] = size;
+        size *= std::size_t (shape[axis]);
+    }
+
+    rowMajor = ! fortranOrder || shape.size() <= 1;
+    data = begin + headerStart + headerLength;
+
+    if (std::size_t (end - data) < size * std::size_t (itemSize))
+    {
+        throw std::runtime_error ("truncated .npy data");
+    }
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include <vector>
+#include <string>
+#include "JuceHeader.h"
+
+
+
+
+// =============================================================================
+/**
+ * Reads an array from a NumPy .npy file, or from a member of a .npz archive.
+ * A .npy file is memory-mapped, and only its header is parsed on
+ * construction; elements are converted from the mapped bytes when they are
+ * read. Byte order, the element type, and Fortran (column-major) layout are
+ * all dealt with while reading, so the file is never rewritten in memory.
+ * Members of .npz archives are extracted to memory first, since they may be
+ * compressed.
+ *
+ * The constructors throw std::runtime_error if the data is not a supported
+ * array: bool, integer, or float elements, of any rank.
+ */
+class NumpyLoader
+{
+public:
+    NumpyLoader (const File& file);
+    NumpyLoader (const File& archive, const String& member);
+
+    const std::vector<int>& getShape() const { return shape; }
+    int getRank() const { return int (shape.size()); }
+    std::size_t getSize() const { return size; }
+    std::string getDescription() const { return descr; }
+    bool isFloat32() const { return kind == 'f' && itemSize == 4; }
+
+    /**
+     * Write every element, converted to ValueType, to the output iterator in
+     * row-major (C) order, regardless of the layout in the file. Given a
+     * pointer to ValueType, native-endian row-major data of the same type is
+     * copied in with a single memcpy.
+     */
+    template <typename ValueType, class OutputIterator>
+    void read (OutputIterator iter) const
+    {
+        switch (kind)
+        {
+            case 'f': return itemSize == 4 ? readAs<float, ValueType> (iter) : readAs<double, ValueType> (iter);
+            case 'i':
+                switch (itemSize)
+                {
+                    case 1: return readAs<int8, ValueType> (iter);
+                    case 2: return readAs<int16, ValueType> (iter);
+                    case 4: return readAs<int32, ValueType> (iter);
+                    default: return readAs<int64, ValueType> (iter);
+                }
+            default:
+                switch (itemSize)
+                {
+                    case 1: return readAs<uint8, ValueType> (iter);
+                    case 2: return readAs<uint16, ValueType> (iter);
+                    case 4: return readAs<uint32, ValueType> (iter);
+                    default: return readAs<uint64, ValueType> (iter);
+                }
+        }
+    }
+
+private:
+    void parseHeader();
+
+    template <typename StoredType, typename ValueType, class OutputIterator>
+    void readAs (OutputIterator iter) const
+    {
+        if (rowMajor && ! swapBytes)
+        {
+            copyElements<StoredType, ValueType> (data, size, iter);
+            return;
+        }
+        auto index = std::vector<int> (shape.size());
+
+        for (std::size_t n = 0; n < size; ++n)
+        {
+            std::size_t offset = 0;
+
+            for (std::size_t axis = 0; axis < shape.size(); ++axis)
+                offset += std::size_t (index[axis]) * strides[axis];
+
+            *iter++ = ValueType (loadElement<StoredType> (offset));
+
+            for (int axis = int (shape.size()) - 1; axis >= 0; --axis)
+            {
+                if (++index[axis] < shape[axis])
+                    break;
+                index[axis] = 0;
+            }
+        }
+    }
+
+    template <typename StoredType, typename ValueType, class OutputIterator>
+    static void copyElements (const char* source, std::size_t count, OutputIterator iter)
+    {
+        for (std::size_t n = 0; n < count; ++n)
+            *iter++ = ValueType (load<StoredType> (source + n * sizeof (StoredType)));
+    }
+
+    template <typename StoredType, typename ValueType>
+    static void copyElements (const char* source, std::size_t count, StoredType* target)
+    {
+        std::memcpy (target, source, count * sizeof (StoredType));
+    }
+
+    template <typename StoredType>
+    StoredType loadElement (std::size_t offset) const
+    {
+        char bytes[sizeof (StoredType)];
+        std::memcpy (bytes, data + offset * sizeof (StoredType), sizeof (StoredType));
+
+        if (swapBytes)
+            std::reverse (bytes, bytes + sizeof (StoredType));
+
+        return load<StoredType> (bytes);
+    }
+
+    template <typename T>
+    static T load (const char* bytes)
+    {
+        T value;
+        std::memcpy (&value, bytes, sizeof (T));
+        return value;
+    }
+
+    std::unique_ptr<MemoryMappedFile> mapped;
+    MemoryBlock extracted;
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    const char* data = nullptr;
+    std::string descr;
+    char kind = 0;
+    int itemSize = 0;
+    bool swapBytes = false;
+    bool rowMajor = true;
+    std::vector<int> shape;
+    std::vector<std::size_t> strides;
+    std::size_t size = 1;
+};
@@ -0,0 +1,206 @@
+#include "Patches2dIndex.hpp"
+
+
+
+
+//=============================================================================
+Patches2dIndex::Patches2dIndex()
+{
+}
+
+std::set<std::string> Patches2dIndex::findPatches (const File& database,
+                                                   const Rectangle<double>& domain,
+                                                   bool spherical,
+                                                   ParallelFor parallelFor)
+{
+    {
+        const ScopedLock sl (lock);
+        auto entry = findEntry (database);
+
+        if (entry == nullptr || entry->spherical != spherical)
+        {
+            // The extents are found without holding the lock; if another
+            // thread builds the same entry meanwhile, the last one wins.
+            // ----------------------------------------------------------------
+            const ScopedUnlock sul (lock);
+            auto built = build (database, spherical, parallelFor);
+            const ScopedLock sl2 (lock);
+            entries[database.getFullPathName()] = built;
+        }
+    }
+
+    const ScopedLock sl (lock);
+    auto& entry = entries[database.getFullPathName()];
+    entry.lastUsed = ++counter;
+    evictEntries();
+
+    const auto& extents = entry.extents;
+    auto result = std::set<std::string>();
+
+    auto last = std::upper_bound (extents.begin(), extents.end(), domain.getRight(), [] (double x, const auto& item)
+    {
+        return x < item.first.getX();
+    });
+
+    for (auto item = extents.begin(); item != last; ++item)
+        if (item->first.getRight() >= domain.getX() && item->first.getY() <= domain.getBottom() && item->first.getBottom() >= domain.getY())
+            result.insert (item->second);
+
+    return result;
+}
+
+bool Patches2dIndex::lookupPatch (const File& database, const std::string& path, nd::array<double, 3>& data)
+{
+    const ScopedLock sl (lock);
+    auto entry = findEntry (database);
+
+    if (entry == nullptr || entry->loaded.count (path) == 0)
+    {
+        return false;
+    }
+    data = entry->loaded.at (path).second;
+    return true;
+}
+
+void Patches2dIndex::storePatch (const File& database, const std::string& path, const std::string& patch, const nd::array<double, 3>& data)
+{
+    const ScopedLock sl (lock);
+
+    if (auto entry = findEntry (database))
+    {
+        entry->loaded[path] = std::make_pair (patch, data);
+    }
+}
+
+void Patches2dIndex::dropPatchesOutside (const File& database, const Rectangle<double>& region)
+{
+    const ScopedLock sl (lock);
+    auto entry = findEntry (database);
+
+    if (entry == nullptr)
+    {
+        return;
+    }
+
+    auto keep = std::set<std::string>();
+
+    for (const auto& item : entry->extents)
+        if (item.first.getX() <= region.getRight() && item.first.getRight() >= region.getX()
+            && item.first.getY() <= region.getBottom() && item.first.getBottom() >= region.getY())
+            keep.insert (item.second);
+
+    for (auto item = entry->loaded.begin(); item != entry->loaded.end();)
+    {
+        if (keep.count (item->second.first))
+            ++item;
+        else
+            item = entry->loaded.erase (item);
+    }
+}
+
+
+
+
+//=============================================================================
+Patches2dIndex::Entry Patches2dIndex::build (const File& database, bool spherical, ParallelFor parallelFor)
+{
+    auto ser = FileSystemSerializer (database);
+    auto patches = std::vector<std::string>();
+    auto paths = std::vector<std::string>();
+
+    for (const auto& patch : ser.list_patches())
+    {
+        for (const auto& name : ser.list_fields (patch))
+        {
+            if (patches2d::parse_field (name) == patches2d::Field::vert_coords)
+            {
+                patches.push_back (patch);
+                paths.push_back (patch + "/" + name);
+            }
+        }
+    }
+
+    auto entry = Entry();
+    entry.modified = database.getLastModificationTime();
+    entry.spherical = spherical;
+    entry.extents.resize (patches.size());
+
+    auto findExtent = [&] (int n)
+    {
+        auto verts = ser.read_array (paths[n]);
+        auto x0 = std::numeric_limits<double>::max();
+        auto x1 = std::numeric_limits<double>::lowest();
+        auto y0 = std::numeric_limits<double>::max();
+        auto y1 = std::numeric_limits<double>::lowest();
+
+        for (int i = 0; i < verts.shape(0); ++i)
+        {
+            for (int j = 0; j < verts.shape(1); ++j)
+            {
+                auto x = verts (i, j, 0);
+                auto y = verts (i, j, 1);
+
+                if (spherical)
+                {
+                    auto r = x;
+                    x = r * std::sin (y);
+                    y = r * std::cos (y);
+                }
+                x0 = jmin (x0, x);
+                x1 = jmax (x1, x);
+                y0 = jmin (y0, y);
+                y1 = jmax (y1, y);
+            }
+        }
+        entry.extents[n] = std::make_pair (Rectangle<double>::leftTopRightBottom (x0, y0, x1, y1), patches[n]);
+    };
+
+    if (parallelFor)
+        parallelFor (int (patches.size()), findExtent);
+    else
+        for (int n = 0; n < patches.size(); ++n)
+            findExtent (n);
+
+    std::sort (entry.extents.begin(), entry.extents.end(), [] (const auto& a, const auto& b)
+    {
+        return a.first.getX() < b.first.getX();
+    });
+    return entry;
+}
+
+Patches2dIndex::Entry* Patches2dIndex::findEntry (const File& database)
+{
+    auto entry = entries.find (database.getFullPathName());
+
+    if (entry == entries.end())
+    {
+        return nullptr;
+    }
+    if (entry->second.modified != database.getLastModificationTime())
+    {
+        entries.erase (entry);
+        return nullptr;
+    }
+    return &entry->second;
+}
+
+void Patches2dIndex::evictEntries()
+{
+    auto order = std::vector<std::map<String, Entry>::iterator>();
+
+    for (auto entry = entries.begin(); entry != entries.end(); ++entry)
+        order.push_back (entry);
+
+    std::sort (order.begin(), order.end(), [] (const auto& a, const auto& b)
+    {
+        return a->second.lastUsed > b->second.lastUsed;
+    });
+
+    for (int n = maxDatabasesWithPatches; n < order.size(); ++n)
+    {
+        if (n < maxDatabases)
+            order[n]->second.loaded.clear();
+        else
+            entries.erase (order[n]);
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "JuceHeader.h"
+
+
+
+
+//=============================================================================
+/**
+ * A process-wide spatial index over the patches of patches2d databases, and a
+ * cache of the patch data that has been read from them. The first time a
+ * database is queried, the extent of each of its patches is found from the
+ * patch vertex coordinates. The patches are kept sorted by their lower x
+ * extent, so a query only looks at patches that start left of the domain's
+ * right edge.
+ *
+ * The patch cache lets load-patches2d read only the patches newly exposed
+ * when a figure is panned; patches far out of view are dropped from it.
+ * Entries for a database are discarded if its modification time changes.
+ * Only the most recently queried databases keep their cached patches, and
+ * only a limited number of databases keep their extents.
+ *
+ * Obtain the index through a SharedResourcePointer<Patches2dIndex>.
+ */
+class Patches2dIndex
+{
+public:
+
+
+    //=========================================================================
+    using ParallelFor = std::function<void(int, std::function<void(int)>)>;
+
+
+    //=========================================================================
+    Patches2dIndex();
+
+
+    /**
+     * Return the names of the patches in the database whose extent intersects
+     * the given domain. If spherical is true, vertex coordinates are taken to
+     * be (r, theta), and the extents are those of the patches after mapping to
+     * (x, z) = (r sin(theta), r cos(theta)), as done by sph-to-cart.
+     */
+    std::set<std::string> findPatches (const File& database,
+                                       const Rectangle<double>& domain,
+                                       bool spherical,
+                                       ParallelFor parallelFor=nullptr);
+
+
+    /**
+     * Look for cached data for the given path (patch/field) in the database.
+     */
+    bool lookupPatch (const File& database, const std::string& path, nd::array<double, 3>& data);
+
+
+    /**
+     * Cache data read from the given path (patch/field) in the database.
+     */
+    void storePatch (const File& database, const std::string& path, const std::string& patch, const nd::array<double, 3>& data);
+
+
+    /**
+     * Drop cached data for patches that do not intersect the given region.
+     */
+    void dropPatchesOutside (const File& database, const Rectangle<double>& region);
+
+
+private:
+
+
+    //=========================================================================
+    struct Entry
+    {
+        Time modified;
+        bool spherical = false;
+        std::vector<std::pair<Rectangle<double>, std::string>> extents;
+        std::map<std::string, std::pair<std::string, nd::array<double, 3>>> loaded;
+        uint32 lastUsed = 0;
+    };
+
+
+    //=========================================================================
+    static Entry build (const File& database, bool spherical, ParallelFor parallelFor);
+    Entry* findEntry (const File& database);
+    void evictEntries();
+
+    static const int maxDatabasesWithPatches = 2;
+    static const int maxDatabases = 32;
+    CriticalSection lock;
+    std::map<String, Entry> entries;
+    uint32 counter = 0;
+};
@@ -0,0 +1,203 @@
+#include "ResultCache.hpp"
+
+
+
+
+//=============================================================================
+ResultCache::ResultCache (std::size_t maximumSizeInBytes) : maximumSize (maximumSizeInBytes)
+{
+}
+
+void ResultCache::setMaximumSize (std::size_t maximumSizeInBytes)
+{
+    maximumSize = maximumSizeInBytes;
+    evictUntilSizeIsAtMost (maximumSize);
+}
+
+void ResultCache::clear()
+{
+    entries.clear();
+    index.clear();
+    currentSize = 0;
+    evictedBytes = 0;
+    numHits = 0;
+    numMisses = 0;
+}
+
+
+
+
+//=============================================================================
+ResultCache::Key ResultCache::makeKey (const Runtime::Kernel& kernel, const std::string& rule, const std::set<std::string>& exclude) const
+{
+    auto key = Key();
+    auto upstream = std::vector<std::string>();
+
+    for (const auto& name : kernel.upstream (rule))
+        if (! exclude.count (name))
+            upstream.push_back (name);
+
+    std::sort (upstream.begin(), upstream.end());
+
+    key.text = rule + ": " + kernel.expr_at (rule).str();
+
+    for (const auto& name : upstream)
+    {
+        if (kernel.contains (name) && (kernel.flags_at (name) & Runtime::builtin) == 0)
+        {
+            const auto& value = kernel.at (name);
+            key.text += "\n" + name + "=" + fingerprint (value, key.cacheable);
+
+            if (isFingerprintedByAddress (value))
+                key.inputs.add (value);
+        }
+    }
+    return key;
+}
+
+std::string ResultCache::fingerprint (const var& value, bool& cacheable) const
+{
+    if (value.isVoid())
+    {
+        return "none";
+    }
+    if (value.isString())
+    {
+        auto str = value.toString();
+
+        if (File::isAbsolutePath (str))
+        {
+            auto stamp = std::string();
+
+            switch (stamps->lookup (str, stamp))
+            {
+                case FileStampCache::Kind::file: return "'" + str.toStdString() + "'@" + stamp;
+                case FileStampCache::Kind::missing: break;
+                case FileStampCache::Kind::unknown:
+                case FileStampCache::Kind::directory: cacheable = false; break;
+            }
+        }
+        return "'" + str.toStdString() + "'";
+    }
+    if (auto arr = value.getArray())
+    {
+        auto result = std::string ("[");
+
+        for (const auto& element : *arr)
+            result += fingerprint (element, cacheable) + " ";
+        return result + "]";
+    }
+    if (auto data = dynamic_cast<Runtime::GenericData*> (value.getObject()))
+    {
+        return "#" + std::to_string (data->serial);
+    }
+    if (auto obj = value.getDynamicObject())
+    {
+        auto result = std::string ("{");
+
+        for (const auto& property : obj->getProperties())
+            result += property.name.toString().toStdString() + "=" + fingerprint (property.value, cacheable) + " ";
+        return result + "}";
+    }
+    if (value.isObject() || value.isMethod())
+    {
+        return String::toHexString ((pointer_sized_int) value.getObject()).toStdString();
+    }
+    return value.toString().toStdString();
+}
+
+bool ResultCache::isFingerprintedByAddress (const var& value)
+{
+    if (auto arr = value.getArray())
+    {
+        return std::any_of (arr->begin(), arr->end(), isFingerprintedByAddress);
+    }
+    if (auto obj = value.getDynamicObject())
+    {
+        for (const auto& property : obj->getProperties())
+            if (isFingerprintedByAddress (property.value))
+                return true;
+
+        return false;
+    }
+    return value.isObject() && dynamic_cast<Runtime::GenericData*> (value.getObject()) == nullptr;
+}
+
+
+
+
+//=============================================================================
+bool ResultCache::lookup (const Key& key, var& result)
+{
+    auto item = key.cacheable ? index.find (key.text) : index.end();
+
+    if (item == index.end())
+    {
+        ++numMisses;
+        return false;
+    }
+    entries.splice (entries.begin(), entries, item->second);
+    result = item->second->value;
+    ++numHits;
+    return true;
+}
+
+void ResultCache::insert (const Key& key, const var& value)
+{
+    if (! key.cacheable)
+    {
+        return;
+    }
+
+    auto bytes = Runtime::size_in_bytes (value);
+
+    for (const auto& input : key.inputs)
+        bytes += Runtime::size_in_bytes (input);
+
+    if (bytes > maximumSize)
+    {
+        return;
+    }
+
+    auto item = index.find (key.text);
+
+    if (item != index.end())
+    {
+        currentSize -= item->second->bytes;
+        entries.erase (item->second);
+        index.erase (item);
+    }
+
+    evictUntilSizeIsAtMost (maximumSize - bytes);
+    entries.push_front ({ key.text, value, key.inputs, bytes });
+    index[key.text] = entries.begin();
+    currentSize += bytes;
+}
+
+StringPairArray ResultCache::getStatistics() const
+{
+    auto result = StringPairArray();
+    auto lookups = numHits + numMisses;
+
+    result.set ("cache size", File::descriptionOfSizeInBytes (int64 (currentSize))
+                + " (" + String (getNumEntries()) + " entries)");
+    result.set ("cache hit rate", lookups == 0 ? "-" : String (100.0 * numHits / lookups, 1) + "%");
+    result.set ("cache evicted", File::descriptionOfSizeInBytes (int64 (evictedBytes)));
+    return result;
+}
+
+
+
+
+//=============================================================================
+void ResultCache::evictUntilSizeIsAtMost (std::size_t targetSize)
+{
+    while (currentSize > targetSize && ! entries.empty())
+    {
+        const auto& entry = entries.back();
+        currentSize -= entry.bytes;
+        evictedBytes += entry.bytes;
+        index.erase (entry.key);
+        entries.pop_back();
+    }
+}
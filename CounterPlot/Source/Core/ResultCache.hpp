@@ -0,0 +1,130 @@
+#pragma once
+#include "JuceHeader.h"
+#include "Runtime.hpp"
+#include "FileStampCache.hpp"
+
+
+
+
+//=============================================================================
+/**
+ * A bounded-memory, least-recently-used cache of resolved rule values. Entries
+ * are keyed by the rule name, its expression, and a fingerprint of each of its
+ * upstream values. Upstream values that name an existing file also contribute
+ * that file's size and modification time, so the cache never returns a result
+ * computed from a file that has since changed. Those are taken from the
+ * FileStampCache, not from the filesystem; a key naming a file that has not
+ * been stamped yet, or naming a directory (whose modification time does not
+ * follow changes to the files in it), is not cacheable. Runtime::Data values are
+ * fingerprinted by their serial number, and dictionaries by their contents, so
+ * an entry does not keep them alive. Any other object is fingerprinted by its
+ * address; an entry keeps such inputs alive, so that the address stays unique
+ * while the entry exists, and counts their size against the cache's budget.
+ *
+ * The cache is not thread-safe, and should be used from the thread that owns
+ * the kernel.
+ */
+class ResultCache
+{
+public:
+
+
+    //=========================================================================
+    struct Key
+    {
+        std::string text;
+        Array<var> inputs;
+        bool cacheable = true;
+    };
+
+
+    //=========================================================================
+    ResultCache (std::size_t maximumSizeInBytes=256 * 1024 * 1024);
+
+
+    /**
+     * Set the maximum number of bytes the cached values may occupy. Least
+     * recently used entries are evicted if the cache is now too large.
+     */
+    void setMaximumSize (std::size_t maximumSizeInBytes);
+
+
+    /**
+     * Remove all entries and reset the statistics.
+     */
+    void clear();
+
+
+    /**
+     * Return a key for the current state of the given rule in the kernel.
+     * Upstream rules named in the exclude set are left out of the key.
+     */
+    Key makeKey (const Runtime::Kernel& kernel, const std::string& rule, const std::set<std::string>& exclude={}) const;
+
+
+    /**
+     * Return a string that identifies the given value. Two values with equal
+     * fingerprints are either equal or the same object. The cacheable flag is
+     * cleared if the value names a path that can't be stamped.
+     */
+    std::string fingerprint (const var& value, bool& cacheable) const;
+
+
+    /**
+     * Return true if the given value's fingerprint is only unique for as long
+     * as the value is kept alive.
+     */
+    static bool isFingerprintedByAddress (const var& value);
+
+
+    /**
+     * Look up an entry. If it exists, it is marked as most recently used, the
+     * result argument is assigned, and true is returned. Keys that are not
+     * cacheable always miss.
+     */
+    bool lookup (const Key& key, var& result);
+
+
+    /**
+     * Insert an entry, evicting least recently used entries as needed. Values
+     * larger than the maximum size, and keys that are not cacheable, are not
+     * inserted.
+     */
+    void insert (const Key& key, const var& value);
+
+
+    /**
+     * Return a set of human-readable figures: size, hit rate, evicted bytes.
+     */
+    StringPairArray getStatistics() const;
+
+
+    //=========================================================================
+    std::size_t getSizeInBytes() const { return currentSize; }
+    std::size_t getEvictedBytes() const { return evictedBytes; }
+    int getNumEntries() const { return int (entries.size()); }
+    int getNumHits() const { return numHits; }
+    int getNumMisses() const { return numMisses; }
+
+
+private:
+    //=========================================================================
+    struct Entry
+    {
+        std::string key;
+        var value;
+        Array<var> inputs;
+        std::size_t bytes = 0;
+    };
+
+    void evictUntilSizeIsAtMost (std::size_t targetSize);
+
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    std::size_t maximumSize = 0;
+    std::size_t currentSize = 0;
+    std::size_t evictedBytes = 0;
+    int numHits = 0;
+    int numMisses = 0;
+    SharedResourcePointer<FileStampCache> stamps;
+};
@@ -1,7 +1,11 @@
-#include <fstream>
 #include "Runtime.hpp"
 #include "DataHelpers.hpp"
 #include "AsciiLoader.hpp"
+#include "NumpyLoader.hpp"
+#include "HDF5Service.hpp"
+#include "TextTableCache.hpp"
+#include "Patches2dIndex.hpp"
+#include "HDF5SeriesCache.hpp"
 #include "../Plotting/Artists.hpp"
 
 
@@ -60,6 +64,12 @@ namespace builtin
         if (value.isArray())
             return DataHelpers::ndarrayDouble1FromVar (value);
 
+        if (auto A = Runtime::opt_data<nd::array<float, 1>> (value))
+        {
+            auto result = nd::array<double, 1> (A->size());
+            std::copy (A->begin(), A->end(), result.begin());
+            return result;
+        }
         return Runtime::check_data<nd::array<double, 1>> (value);
     }
 
@@ -89,12 +99,12 @@ namespace builtin
     {
         auto value = checkArg (caller, args, index);
 
-        if (auto result = dynamic_cast<Runtime::Data<nd::array<double, 1>>*> (value.getObject()))
-            return result->value;
-        if (auto result = dynamic_cast<Runtime::Data<nd::array<double, 2>>*> (value.getObject()))
-            return result->value.reshape (int (result->value.size()));
-        if (auto result = dynamic_cast<Runtime::Data<nd::array<double, 3>>*> (value.getObject()))
-            return result->value.reshape (int (result->value.size()));
+        if (auto result = Runtime::opt_data<nd::array<double, 1>> (value))
+            return *result;
+        if (auto result = Runtime::opt_data<nd::array<double, 2>> (value))
+            return result->reshape (int (result->size()));
+        if (auto result = Runtime::opt_data<nd::array<double, 3>> (value))
+            return result->reshape (int (result->size()));
 
         return Runtime::check_data<nd::array<double, 1>> (value, caller, index); // will throw
     }
@@ -122,6 +132,25 @@ namespace builtin
         return nullptr;
     }
 
+    MeshHelpers::ParallelFor optParallelFor (var::NativeFunctionArgs args)
+    {
+        if (args.thisObject.hasProperty (VarCallAdapter::BailoutChecker::argkey))
+        {
+            auto value = args.thisObject[VarCallAdapter::BailoutChecker::argkey];
+            auto checker = ReferenceCountedObjectPtr<VarCallAdapter::BailoutChecker> (dynamic_cast<VarCallAdapter::BailoutChecker*> (value.getObject()));
+
+            return [checker] (int numItems, std::function<void(int)> body)
+            {
+                checker->parallelFor (numItems, body);
+            };
+        }
+        return [] (int numItems, std::function<void(int)> body)
+        {
+            for (int n = 0; n < numItems; ++n)
+                body (n);
+        };
+    }
+
 
     //=========================================================================
     var list (var::NativeFunctionArgs args)
@@ -282,7 +311,25 @@ namespace builtin
             for (auto& x : res) x = std::log10(x);
             return Runtime::make_data (res);
         }
-        throw std::runtime_error ("log10 requires an array of type double");
+        if (auto A = Runtime::opt_data<nd::array<float, 1>> (value))
+        {
+            auto res = A->copy();
+            for (auto& x : res) x = std::log10(x);
+            return Runtime::make_data (res);
+        }
+        if (auto A = Runtime::opt_data<nd::array<float, 2>> (value))
+        {
+            auto res = A->copy();
+            for (auto& x : res) x = std::log10(x);
+            return Runtime::make_data (res);
+        }
+        if (auto A = Runtime::opt_data<nd::array<float, 3>> (value))
+        {
+            auto res = A->copy();
+            for (auto& x : res) x = std::log10(x);
+            return Runtime::make_data (res);
+        }
+        throw std::runtime_error ("log10 requires an array of type double or float");
     }
 
 
@@ -307,7 +354,19 @@ namespace builtin
         {
             return Runtime::make_data (*A);
         }
-        throw std::runtime_error ("noscale requires an array of type double");
+        if (auto A = Runtime::opt_data<nd::array<float, 1>> (value))
+        {
+            return Runtime::make_data (*A);
+        }
+        if (auto A = Runtime::opt_data<nd::array<float, 2>> (value))
+        {
+            return Runtime::make_data (*A);
+        }
+        if (auto A = Runtime::opt_data<nd::array<float, 3>> (value))
+        {
+            return Runtime::make_data (*A);
+        }
+        throw std::runtime_error ("noscale requires an array of type double or float");
     }
 
 
@@ -327,6 +386,15 @@ namespace builtin
         if (auto a = Runtime::opt_data<nd::array<double, 3>> (A))
             if (auto b = Runtime::opt_data<nd::array<double, 3>> (B))
                 return Runtime::make_data (*a + *b);
+        if (auto a = Runtime::opt_data<nd::array<float, 1>> (A))
+            if (auto b = Runtime::opt_data<nd::array<float, 1>> (B))
+                return Runtime::make_data (*a + *b);
+        if (auto a = Runtime::opt_data<nd::array<float, 2>> (A))
+            if (auto b = Runtime::opt_data<nd::array<float, 2>> (B))
+                return Runtime::make_data (*a + *b);
+        if (auto a = Runtime::opt_data<nd::array<float, 3>> (A))
+            if (auto b = Runtime::opt_data<nd::array<float, 3>> (B))
+                return Runtime::make_data (*a + *b);
         throw std::runtime_error ("add could not understand arguments");
     }
 
@@ -346,6 +414,15 @@ namespace builtin
         if (auto a = Runtime::opt_data<nd::array<double, 3>> (A))
             if (auto b = Runtime::opt_data<nd::array<double, 3>> (B))
                 return Runtime::make_data (*a - *b);
+        if (auto a = Runtime::opt_data<nd::array<float, 1>> (A))
+            if (auto b = Runtime::opt_data<nd::array<float, 1>> (B))
+                return Runtime::make_data (*a - *b);
+        if (auto a = Runtime::opt_data<nd::array<float, 2>> (A))
+            if (auto b = Runtime::opt_data<nd::array<float, 2>> (B))
+                return Runtime::make_data (*a - *b);
+        if (auto a = Runtime::opt_data<nd::array<float, 3>> (A))
+            if (auto b = Runtime::opt_data<nd::array<float, 3>> (B))
+                return Runtime::make_data (*a - *b);
         throw std::runtime_error ("sub could not understand arguments");
     }
 
@@ -366,6 +443,15 @@ namespace builtin
         if (auto a = Runtime::opt_data<nd::array<double, 3>> (A))
             if (auto b = Runtime::opt_data<nd::array<double, 3>> (B))
                 return Runtime::make_data (*a * *b);
+        if (auto a = Runtime::opt_data<nd::array<float, 1>> (A))
+            if (auto b = Runtime::opt_data<nd::array<float, 1>> (B))
+                return Runtime::make_data (*a * *b);
+        if (auto a = Runtime::opt_data<nd::array<float, 2>> (A))
+            if (auto b = Runtime::opt_data<nd::array<float, 2>> (B))
+                return Runtime::make_data (*a * *b);
+        if (auto a = Runtime::opt_data<nd::array<float, 3>> (A))
+            if (auto b = Runtime::opt_data<nd::array<float, 3>> (B))
+                return Runtime::make_data (*a * *b);
         throw std::runtime_error ("mul could not understand arguments");
     }
 
@@ -386,6 +472,15 @@ namespace builtin
         if (auto a = Runtime::opt_data<nd::array<double, 3>> (A))
             if (auto b = Runtime::opt_data<nd::array<double, 3>> (B))
                 return Runtime::make_data (*a / *b);
+        if (auto a = Runtime::opt_data<nd::array<float, 1>> (A))
+            if (auto b = Runtime::opt_data<nd::array<float, 1>> (B))
+                return Runtime::make_data (*a / *b);
+        if (auto a = Runtime::opt_data<nd::array<float, 2>> (A))
+            if (auto b = Runtime::opt_data<nd::array<float, 2>> (B))
+                return Runtime::make_data (*a / *b);
+        if (auto a = Runtime::opt_data<nd::array<float, 3>> (A))
+            if (auto b = Runtime::opt_data<nd::array<float, 3>> (B))
+                return Runtime::make_data (*a / *b);
         throw std::runtime_error ("div could not understand arguments");
     }
 
@@ -398,7 +493,10 @@ namespace builtin
         if (auto A = Runtime::opt_data<nd::array<double, 1>> (value)) return *std::min_element (A->begin(), A->end());
         if (auto A = Runtime::opt_data<nd::array<double, 2>> (value)) return *std::min_element (A->begin(), A->end());
         if (auto A = Runtime::opt_data<nd::array<double, 3>> (value)) return *std::min_element (A->begin(), A->end());
-        throw std::runtime_error ("min requires an array of type double");
+        if (auto A = Runtime::opt_data<nd::array<float, 1>> (value)) return double (*std::min_element (A->begin(), A->end()));
+        if (auto A = Runtime::opt_data<nd::array<float, 2>> (value)) return double (*std::min_element (A->begin(), A->end()));
+        if (auto A = Runtime::opt_data<nd::array<float, 3>> (value)) return double (*std::min_element (A->begin(), A->end()));
+        throw std::runtime_error ("min requires an array of type double or float");
     }
 
 
@@ -410,17 +508,18 @@ namespace builtin
         if (auto A = Runtime::opt_data<nd::array<double, 1>> (value)) return *std::max_element (A->begin(), A->end());
         if (auto A = Runtime::opt_data<nd::array<double, 2>> (value)) return *std::max_element (A->begin(), A->end());
         if (auto A = Runtime::opt_data<nd::array<double, 3>> (value)) return *std::max_element (A->begin(), A->end());
-        throw std::runtime_error ("max requires an array of type double");
+        if (auto A = Runtime::opt_data<nd::array<float, 1>> (value)) return double (*std::max_element (A->begin(), A->end()));
+        if (auto A = Runtime::opt_data<nd::array<float, 2>> (value)) return double (*std::max_element (A->begin(), A->end()));
+        if (auto A = Runtime::opt_data<nd::array<float, 3>> (value)) return double (*std::max_element (A->begin(), A->end()));
+        throw std::runtime_error ("max requires an array of type double or float");
     }
 
 
     //=========================================================================
-    var cartprod (var::NativeFunctionArgs args)
+    template<typename ValueType>
+    var makeCartesianProduct (const nd::array<double, 1>& x, const nd::array<double, 1>& y, std::function<bool()> bailout)
     {
-        auto bailout = optBailout (args);
-        auto x = checkArg<nd::array<double, 1>> ("cartprod", args, 0);
-        auto y = checkArg<nd::array<double, 1>> ("cartprod", args, 1);
-        auto c = nd::array<double, 3> (x.size(), y.size(), 2);
+        auto c = nd::array<ValueType, 3> (x.size(), y.size(), 2);
 
         for (int i = 0; i < x.size(); ++i)
         {
@@ -436,6 +535,24 @@ namespace builtin
         return Runtime::make_data(c);
     }
 
+    var cartprod (var::NativeFunctionArgs args)
+    {
+        // With dtype='float32' the vertices are made in single precision,
+        // which is what to-gpu-triangulate needs in the end, at half the size.
+        // --------------------------------------------------------------------
+        auto bailout = optBailout (args);
+        auto x = checkArg<nd::array<double, 1>> ("cartprod", args, 0);
+        auto y = checkArg<nd::array<double, 1>> ("cartprod", args, 1);
+        auto dtype = optKeywordArg<String> (args, "dtype", "float64");
+
+        if (dtype == "float32")
+            return makeCartesianProduct<float> (x, y, bailout);
+        if (dtype == "float64")
+            return makeCartesianProduct<double> (x, y, bailout);
+
+        throw std::runtime_error ("cartprod: dtype must be 'float32' or 'float64'");
+    }
+
 
     //=========================================================================
     var sph_to_cart (var::NativeFunctionArgs args)
@@ -468,8 +585,14 @@ namespace builtin
     var to_gpu_triangulate (var::NativeFunctionArgs args)
     {
         auto bailout = optBailout (args);
-        auto vertices = checkArgData<nd::array<double, 3>> ("to_gpu_triangulate", args, 0);
-        auto triverts = MeshHelpers::triangulateQuadMesh (vertices, bailout);
+        auto parallelFor = optParallelFor (args);
+        auto value = checkArg ("to_gpu_triangulate", args, 0);
+        auto triverts = std::vector<simd::float2>();
+
+        if (auto vertices = Runtime::opt_data<nd::array<float, 3>> (value))
+            triverts = MeshHelpers::triangulateQuadMesh (*vertices, bailout, parallelFor);
+        else
+            triverts = MeshHelpers::triangulateQuadMesh (checkArgData<nd::array<double, 3>> ("to_gpu_triangulate", args, 0), bailout, parallelFor);
 
         if (bailout && bailout())
         {
@@ -480,11 +603,9 @@ namespace builtin
 
 
     //=========================================================================
-    var to_gpu (var::NativeFunctionArgs args)
+    template<typename Container>
+    std::vector<simd::float1> replicateForDevice (const Container& data, int reps)
     {
-        auto data = checkFlatten  ("to_gpu_replicate", args, 0);
-        auto reps = optKeywordArg<int> (args, "replicate", 1);
-
         std::vector<simd::float1> result;
         result.reserve (data.size() * reps);
 
@@ -492,7 +613,26 @@ namespace builtin
             for (int n = 0; n < reps; ++n)
                 result.push_back(x);
 
-        return Runtime::make_data (DeviceBufferFloat1 (result));
+        return result;
+    }
+
+    var to_gpu (var::NativeFunctionArgs args)
+    {
+        auto value = checkArg ("to_gpu_replicate", args, 0);
+        auto reps = optKeywordArg<int> (args, "replicate", 1);
+
+        // Float data is copied straight into the device buffer, without being
+        // widened to double on the way.
+        // --------------------------------------------------------------------
+        if (auto A = Runtime::opt_data<nd::array<float, 1>> (value))
+            return Runtime::make_data (DeviceBufferFloat1 (replicateForDevice (*A, reps)));
+        if (auto A = Runtime::opt_data<nd::array<float, 2>> (value))
+            return Runtime::make_data (DeviceBufferFloat1 (replicateForDevice (*A, reps)));
+        if (auto A = Runtime::opt_data<nd::array<float, 3>> (value))
+            return Runtime::make_data (DeviceBufferFloat1 (replicateForDevice (*A, reps)));
+
+        auto data = checkFlatten ("to_gpu_replicate", args, 0);
+        return Runtime::make_data (DeviceBufferFloat1 (replicateForDevice (data, reps)));
     }
 
 
@@ -601,94 +741,728 @@ namespace builtin
 
     
     //=========================================================================
+    /**
+     * The columns of one text table, fetched on demand: from the text table
+     * cache if the column is there, otherwise decoded by an AsciiLoader (made
+     * when first needed) and then written to the cache. Single precision
+     * columns are decoded straight to float; since the cache holds doubles,
+     * they are only read from it, not written to it.
+     */
+    struct TextTableSource
+    {
+        TextTableSource (const File& file, unsigned long numRows) : file (file), numRows (numRows) {}
+
+        template<typename ValueType>
+        nd::array<ValueType, 1> getColumn (int index)
+        {
+            auto data = nd::array<ValueType, 1>();
+
+            if (cache->readColumn (file, index, data))
+            {
+                return data;
+            }
+            auto table = getLoader (index);
+            return decode (*table, index, data);
+        }
+
+        nd::array<double, 1> decode (AsciiLoader& table, int index, nd::array<double, 1>&)
+        {
+            auto data = table.getColumn (index);
+            cache->writeColumn (file, index, data);
+            return data;
+        }
+
+        nd::array<float, 1> decode (AsciiLoader& table, int index, nd::array<float, 1>&)
+        {
+            return table.getFloatColumn (index);
+        }
+
+        std::shared_ptr<AsciiLoader> getLoader (int index)
+        {
+            auto table = std::shared_ptr<AsciiLoader>();
+            {
+                const ScopedLock sl (lock);
+
+                if (loader == nullptr)
+                    loader = std::make_shared<AsciiLoader> (file);
+
+                table = loader;
+            }
+
+            if (! table->getStatusMessage().empty())
+            {
+                throw std::runtime_error (table->getStatusMessage());
+            }
+            if (table->getNumRows() != numRows || index >= table->getNumColumns())
+            {
+                throw std::runtime_error ("load-text: file changed while it was being loaded");
+            }
+            return table;
+        }
+
+        File file;
+        unsigned long numRows = 0;
+        std::shared_ptr<AsciiLoader> loader;
+        CriticalSection lock;
+        SharedResourcePointer<TextTableCache> cache;
+    };
+
+    /**
+     * The loaders of tables loaded with tail=true, so that a later load can
+     * append the rows written since. Only the most recently loaded few are
+     * kept, since each holds its file mapped and all of its columns.
+     */
+    struct TailedTextTables
+    {
+        struct Table
+        {
+            CriticalSection lock;
+            std::shared_ptr<AsciiLoader> loader;
+            uint32 lastUsed = 0;
+        };
+        static const int maxTables = 8;
+        CriticalSection lock;
+        std::map<String, std::shared_ptr<Table>> tables;
+        uint32 counter = 0;
+    };
+
+    var loadTextTail (const File& file, const String& dtype, MeshHelpers::ParallelFor parallelFor)
+    {
+        auto tailed = SharedResourcePointer<TailedTextTables>();
+        auto table = std::shared_ptr<TailedTextTables::Table>();
+        {
+            const ScopedLock sl (tailed->lock);
+
+            if (tailed->tables.count (file.getFullPathName()) == 0 && tailed->tables.size() >= TailedTextTables::maxTables)
+            {
+                tailed->tables.erase (std::min_element (tailed->tables.begin(), tailed->tables.end(), [] (const auto& a, const auto& b)
+                {
+                    return a.second->lastUsed < b.second->lastUsed;
+                }));
+            }
+
+            auto& entry = tailed->tables[file.getFullPathName()];
+
+            if (entry == nullptr)
+                entry = std::make_shared<TailedTextTables::Table>();
+
+            entry->lastUsed = ++tailed->counter;
+            table = entry;
+        }
+
+
+        // The shared lock is only held for the lookup; loads of one table
+        // wait for each other here, but not for loads of other tables.
+        // --------------------------------------------------------------------
+        const ScopedLock sl (table->lock);
+        auto& loader = table->loader;
+
+        if (loader == nullptr || ! loader->appendNewRows (file))
+        {
+            loader = std::make_shared<AsciiLoader> (file, parallelFor);
+            loader->loadAllColumns (parallelFor);
+        }
+
+        if (! loader->getStatusMessage().empty())
+        {
+            auto message = loader->getStatusMessage();
+            loader = nullptr;
+            throw std::runtime_error (message);
+        }
+
+        auto columns = Array<var>();
+
+        // Columns are handed out as views of the loader's storage. Tailed
+        // columns are kept in double precision, so that rows can be appended
+        // to them; the loader keeps float32 columns narrowed alongside, and
+        // narrows only the appended rows.
+        // --------------------------------------------------------------------
+        for (int n = 0; n < loader->getNumColumns(); ++n)
+        {
+            if (dtype == "float32")
+                columns.add (Runtime::make_data (loader->getFloatColumn (n)));
+            else
+                columns.add (Runtime::make_data (loader->getColumn (n)));
+        }
+        return columns;
+    }
+
     var load_text (var::NativeFunctionArgs args)
     {
-        auto fname = checkArg<std::string> ("load-text", args, 0);
-        auto stream = std::ifstream (fname);
-        auto loader = AsciiLoader (stream);
+        // The file is indexed here (or found in the text table cache), but
+        // each column is only decoded when some downstream rule first asks for
+        // its data. Wide tables of which only a few columns are used cost
+        // little more than one scan.
+        //
+        // With tail=true, the table is instead kept loaded between calls. If
+        // the file has only been appended to since, just the new rows are
+        // parsed, and the columns are returned in full.
+        // --------------------------------------------------------------------
+        auto file = checkArg<File> ("load-text", args, 0);
+        auto dtype = optKeywordArg<String> (args, "dtype", "float64");
+        auto tail = optKeywordArg (args, "tail", false);
+        auto cache = SharedResourcePointer<TextTableCache>();
+        auto info = TextTableCache::TableInfo();
+        auto loader = std::shared_ptr<AsciiLoader>();
+
+        if (dtype != "float64" && dtype != "float32")
+        {
+            throw std::runtime_error ("load-text: dtype must be 'float32' or 'float64'");
+        }
 
-        if (! loader.getStatusMessage().empty())
+        if (tail)
         {
-            throw std::runtime_error (loader.getStatusMessage());
+            return loadTextTail (file, dtype, optParallelFor (args));
         }
 
+        if (! cache->lookup (file, info))
+        {
+            loader = std::make_shared<AsciiLoader> (file, optParallelFor (args));
+
+            if (! loader->getStatusMessage().empty())
+            {
+                throw std::runtime_error (loader->getStatusMessage());
+            }
+            for (int n = 0; n < loader->getNumColumns(); ++n)
+                info.names.push_back (loader->getColumnName (n));
+
+            info.numRows = loader->getNumRows();
+            cache->writeTable (file, info);
+        }
+
+        auto table = std::make_shared<TextTableSource> (file, info.numRows);
         auto columns = Array<var>();
+        table->loader = loader;
 
-        for (int n = 0; n < loader.getNumColumns(); ++n)
+        for (int n = 0; n < info.names.size(); ++n)
         {
-            auto name = loader.getColumnName(n);
-            auto data = nd::array<double, 1> (loader.getNumRows());
-            loader.column (n, data.begin());
-            columns.add (Runtime::make_data (data));
+            if (dtype == "float32")
+            {
+                columns.add (Runtime::make_lazy_data<nd::array<float, 1>> ([table, n]
+                {
+                    return table->getColumn<float> (n);
+                }));
+            }
+            else
+            {
+                columns.add (Runtime::make_lazy_data<nd::array<double, 1>> ([table, n]
+                {
+                    return table->getColumn<double> (n);
+                }));
+            }
         }
         return columns;
     }
 
 
     //=========================================================================
+    template<typename ValueType>
+    var makeLazyNumpyArray (std::shared_ptr<NumpyLoader> loader)
+    {
+        const auto& shape = loader->getShape();
+
+        switch (loader->getRank())
+        {
+            case 1: return Runtime::make_lazy_data<nd::array<ValueType, 1>> ([loader, shape]
+            {
+                auto data = nd::array<ValueType, 1> (shape[0]);
+                loader->read<ValueType> (data.data());
+                return data;
+            });
+            case 2: return Runtime::make_lazy_data<nd::array<ValueType, 2>> ([loader, shape]
+            {
+                auto data = nd::array<ValueType, 2> (shape[0], shape[1]);
+                loader->read<ValueType> (data.data());
+                return data;
+            });
+            case 3: return Runtime::make_lazy_data<nd::array<ValueType, 3>> ([loader, shape]
+            {
+                auto data = nd::array<ValueType, 3> (shape[0], shape[1], shape[2]);
+                loader->read<ValueType> (data.data());
+                return data;
+            });
+        }
+        throw std::runtime_error ("only rank 1, 2, or 3 NumPy arrays are supported");
+    }
+
+    var makeNumpyData (std::shared_ptr<NumpyLoader> loader, const String& dtype)
+    {
+        // The loader (and with it the file mapping) is kept alive by the lazy
+        // data until the array is first asked for. Scalars are read now.
+        // --------------------------------------------------------------------
+        if (dtype != "native" && dtype != "float32" && dtype != "float64")
+        {
+            throw std::runtime_error ("dtype must be 'native', 'float32', or 'float64'");
+        }
+
+        if (loader->getRank() == 0)
+        {
+            double value;
+            loader->read<double> (&value);
+            return value;
+        }
+
+        if (dtype == "float32" || (dtype == "native" && loader->isFloat32()))
+        {
+            return makeLazyNumpyArray<float> (loader);
+        }
+        return makeLazyNumpyArray<double> (loader);
+    }
+
+    var load_npy (var::NativeFunctionArgs args)
+    {
+        auto file = checkArg<File> ("load-npy", args, 0);
+        auto dtype = optKeywordArg<String> (args, "dtype", "native");
+        return makeNumpyData (std::make_shared<NumpyLoader> (file), dtype);
+    }
+
+    var load_npz (var::NativeFunctionArgs args)
+    {
+        auto file = checkArg<File> ("load-npz", args, 0);
+        auto member = checkArg<String> ("load-npz", args, 1);
+        auto dtype = optKeywordArg<String> (args, "dtype", "native");
+        return makeNumpyData (std::make_shared<NumpyLoader> (file, member), dtype);
+    }
+
+    //=========================================================================
+    std::vector<int> optAxisKeywordArg (const var& keywords, String key, int numAxes, int defaultValue)
+    {
+        auto value = keywords.getProperty (key, keywords["window"].getProperty (key, var()));
+        auto result = std::vector<int> (numAxes, defaultValue);
+
+        if (value.isVoid())
+        {
+            return result;
+        }
+        if (! value.isArray())
+        {
+            std::fill (result.begin(), result.end(), int (value));
+            return result;
+        }
+        if (value.size() != numAxes)
+        {
+            throw std::runtime_error ("load-hdf5: " + key.toStdString() + " needs "
+                                      + std::to_string (numAxes) + " entries, got "
+                                      + std::to_string (value.size()));
+        }
+        for (int n = 0; n < numAxes; ++n)
+            result[n] = value[n];
+
+        return result;
+    }
+
+    template<typename ValueType, typename Dataset>
+    var readHyperslab (Dataset& h5d,
+                       int rank,
+                       const std::vector<int>& start,
+                       const std::vector<int>& count,
+                       const std::vector<int>& stride)
+    {
+        // The selection is read straight into the storage of an array of
+        // its shape; any trailing axes have been sliced to a count of one.
+        // --------------------------------------------------------------------
+        auto fspace = h5d.get_space();
+        auto mspace = h5::Dataspace::simple (count);
+        fspace.select (start, count, stride);
+
+        if (rank == 1)
+        {
+            auto arr = nd::array<ValueType, 1> (count[0]);
+            h5d.read (arr.data(), mspace, fspace);
+            return Runtime::make_data (arr);
+        }
+        auto arr = nd::array<ValueType, 2> (count[0], count[1]);
+        h5d.read (arr.data(), mspace, fspace);
+        return Runtime::make_data (arr);
+    }
+
     var load_hdf5 (var::NativeFunctionArgs args)
     {
-        ScopedLock lock (DataHelpers::getCriticalSectionForHDF5());
+        auto bailout = optBailout (args);
         auto fname = checkArg<std::string> ("load-hdf5", args, 0);
         auto dname = checkArg<std::string> ("load-hdf5", args, 1);
-        auto h5f = h5::File (fname, "r");
-        auto h5d = h5f.open_dataset(dname);
+        auto skip = optKeywordArg (args, "skip", 1);
+        auto dtype = optKeywordArg<String> (args, "dtype", "native");
+        auto service = SharedResourcePointer<HDF5Service>();
 
-        if (h5d.get_space().rank() == 0)
+        if (dtype != "native" && dtype != "float32" && dtype != "float64")
         {
-            if (h5d.get_type() == h5::native_type<int>())
-                return h5d.read<int>();
-            if (h5d.get_type() == h5::native_type<double>())
-                return h5d.read<double>();
-            if (h5d.get_type() == h5::native_type<std::string>())
-                return String (h5d.read<std::string>());
-            throw std::runtime_error ("HDF5 unsupported scalar data type: " + dname);
+            throw std::runtime_error ("load-hdf5: dtype must be 'native', 'float32', or 'float64'");
         }
-        if (h5d.get_space().rank() == 1)
+
+
+        // The start, count, and stride keywords apply per axis to the first
+        // one (rank 1) or two (rank 2 and higher) axes; they may also be given
+        // together in a window dictionary, as returned by lod-window. A count
+        // must select at least one element. Higher-rank data must also be
+        // given a slice: one index for each of the trailing axes. All of these
+        // are pushed down into an HDF5 hyperslab selection, so only the
+        // selected elements are read from disk.
+        // --------------------------------------------------------------------
+        auto keywords = args.thisObject;
+
+        auto read = [dname, skip, dtype, keywords] (h5::File& h5f) -> var
+        {
+            auto h5d = h5f.open_dataset(dname);
+            auto space = h5d.get_space();
+            auto rank = int (space.rank());
+
+            if (rank == 0)
+            {
+                if (h5d.get_type() == h5::native_type<int>())
+                    return h5d.read<int>();
+                if (h5d.get_type() == h5::native_type<double>())
+                    return h5d.read<double>();
+                if (h5d.get_type() == h5::native_type<std::string>())
+                    return String (h5d.read<std::string>());
+                throw std::runtime_error ("HDF5 unsupported scalar data type: " + dname);
+            }
+
+            auto numAxes = jmin (rank, 2);
+            auto extent = std::vector<int>();
+
+            for (auto n : space.extent())
+                extent.push_back (int (n));
+
+            auto start  = optAxisKeywordArg (keywords, "start",  numAxes, 0);
+            auto stride = optAxisKeywordArg (keywords, "stride", numAxes, rank == 1 ? skip : 1);
+            auto count  = optAxisKeywordArg (keywords, "count",  numAxes, -1);
+            auto slice  = optAxisKeywordArg (keywords, "slice",  rank - numAxes, -1);
+
+            for (int n = 0; n < numAxes; ++n)
+            {
+                if (stride[n] < 1 || start[n] < 0 || start[n] >= extent[n])
+                    throw std::runtime_error ("load-hdf5: start or stride out of range on axis " + std::to_string (n));
+
+                if (count[n] == -1)
+                    count[n] = (extent[n] - start[n] + stride[n] - 1) / stride[n];
+
+                if (count[n] < 1 || start[n] + (count[n] - 1) * stride[n] >= extent[n])
+                    throw std::runtime_error ("load-hdf5: count out of range on axis " + std::to_string (n));
+            }
+
+            for (int n = numAxes; n < rank; ++n)
+            {
+                if (slice[n - numAxes] < 0 || slice[n - numAxes] >= extent[n])
+                    throw std::runtime_error ("load-hdf5: rank " + std::to_string (rank) + " dataset needs a slice index in range on axis " + std::to_string (n));
+
+                start.push_back (slice[n - numAxes]);
+                count.push_back (1);
+                stride.push_back (1);
+            }
+
+            // Float datasets are read as float unless float64 is asked for; the
+            // conversion from any other type is done by HDF5 while reading.
+            // ----------------------------------------------------------------
+            if (dtype == "float32" || (dtype == "native" && h5d.get_type() == h5::native_type<float>()))
+            {
+                return readHyperslab<float> (h5d, rank, start, count, stride);
+            }
+            return readHyperslab<double> (h5d, rank, start, count, stride);
+        };
+
+        auto future = service->submit<var> (fname, HDF5Service::Priority::bulk, read, bailout);
+        return HDF5Service::waitFor (future, bailout);
+    }
+
+    var load_series (var::NativeFunctionArgs args)
+    {
+        // Returns the value of a scalar dataset in each of a set of HDF5
+        // files, as a 1D array ordered by file name. The files are those in a
+        // directory matching the pattern keyword (default *.h5), or those
+        // matching a wildcard in the last component of the given path. Values
+        // are kept in a persistent cache, so when new files appear, only they
+        // are read. All the reads are queued on the HDF5 service at once; a
+        // file that can't be read (e.g. one still being written) gives NaN.
+        // --------------------------------------------------------------------
+        auto bailout = optBailout (args);
+        auto parallelFor = optParallelFor (args);
+        auto path = checkArg<File> ("load-series", args, 0);
+        auto dname = checkArg<String> ("load-series", args, 1);
+        auto pattern = optKeywordArg<String> (args, "pattern", "*.h5");
+        auto service = SharedResourcePointer<HDF5Service>();
+        auto cache = SharedResourcePointer<HDF5SeriesCache>();
+
+        if (! path.isDirectory())
         {
-            auto _ = nd::axis::all();
-            auto skip = optKeywordArg (args, "skip", 1);
-            auto arr = h5f.read<nd::array<double, 1>> (dname);
-            return Runtime::make_data (arr.select (_|0|int(arr.size())|skip));
+            pattern = path.getFileName();
+            path = path.getParentDirectory();
         }
-        if (h5d.get_space().rank() == 2)
+
+        auto files = path.findChildFiles (File::findFiles, false, pattern);
+        auto numFiles = files.size();
+        auto values = nd::array<double, 1> (numFiles);
+        auto cached = std::vector<char> (numFiles);
+        auto futures = std::vector<std::future<double>> (numFiles);
+
+        files.sort();
+
+        parallelFor (numFiles, [&] (int n)
         {
-            auto arr = h5f.read<nd::array<double, 2>> (dname);
-            return Runtime::make_data (arr);
+            cached[n] = cache->lookup (files[n], dname, values(n));
+        });
+
+        for (int n = 0; n < numFiles; ++n)
+        {
+            if (! cached[n])
+            {
+                futures[n] = service->submit<double> (files[n].getFullPathName().toStdString(), HDF5Service::Priority::bulk, [dname] (h5::File& h5f)
+                {
+                    auto h5d = h5f.open_dataset (dname.toStdString());
+
+                    if (h5d.get_space().rank() != 0)
+                        throw std::runtime_error ("load-series: dataset is not a scalar");
+
+                    if (h5d.get_type() == h5::native_type<int>())
+                        return double (h5d.read<int>());
+                    return h5d.read<double>();
+                }, bailout);
+            }
+        }
+
+        for (int n = 0; n < numFiles; ++n)
+        {
+            if (cached[n])
+            {
+                continue;
+            }
+
+            try {
+                values(n) = HDF5Service::waitFor (futures[n], bailout);
+
+                if (bailout && bailout())
+                    return var();
+
+                cache->store (files[n], dname, values(n));
+            }
+            catch (const std::exception&)
+            {
+                values(n) = std::numeric_limits<double>::quiet_NaN();
+            }
         }
-        throw std::runtime_error ("HDF5 dataset rank not 0, 1, or 2: " + dname);
+        cache->saveIfNeeded();
+        return Runtime::make_data (values);
+    }
+
+
+    //=========================================================================
+    std::array<int, 3> lodAxisWindow (const nd::array<double, 1>& edges, double lower, double upper, double pixels)
+    {
+        int numCells = int (edges.size()) - 1;
+        int i0 = 0;
+        int i1 = numCells;
+
+        if (numCells < 1)
+        {
+            throw std::runtime_error ("lod-window: need at least two vertex coordinates on each axis");
+        }
+        while (i0 < numCells - 1 && edges (i0 + 1) <= lower) ++i0;
+        while (i1 > i0 + 1 && edges (i1 - 1) >= upper) --i1;
+
+        int n = i1 - i0;
+        int stride = pixels >= 1 ? jmax (1, int (n / pixels)) : 1;
+        int count = (n + stride - 1) / stride;
+
+        return {{ i0, count, stride }};
+    }
+
+    var lod_window (var::NativeFunctionArgs args)
+    {
+        // Returns a window {start, count, stride} over the cells of a 2D field
+        // having the given vertex coordinates, covering the cells inside the
+        // domain [x0 x1 y0 y1], and decimated to about one cell per pixel
+        // (times the detail factor). Without a domain the whole field is
+        // covered, and without a pixel size it is not decimated.
+        // --------------------------------------------------------------------
+        auto x      = checkArg<nd::array<double, 1>> ("lod-window", args, 0);
+        auto y      = checkArg<nd::array<double, 1>> ("lod-window", args, 1);
+        auto domain = args.numArguments > 2 ? args.arguments[2] : var();
+        auto pixels = args.numArguments > 3 ? args.arguments[3] : var();
+        auto detail = optKeywordArg (args, "detail", 1.0);
+        auto hasDomain = domain.isArray() && domain.size() == 4;
+        auto hasPixels = pixels.isArray() && pixels.size() == 2;
+
+        auto wx = lodAxisWindow (x,
+                                 hasDomain ? double (domain[0]) : x (0),
+                                 hasDomain ? double (domain[1]) : x (int (x.size()) - 1),
+                                 hasPixels ? double (pixels[0]) * detail : 0.0);
+        auto wy = lodAxisWindow (y,
+                                 hasDomain ? double (domain[2]) : y (0),
+                                 hasDomain ? double (domain[3]) : y (int (y.size()) - 1),
+                                 hasPixels ? double (pixels[1]) * detail : 0.0);
+
+        auto window = var (new DynamicObject);
+        window.getDynamicObject()->setProperty ("start",  Array<var> { wx[0], wy[0] });
+        window.getDynamicObject()->setProperty ("count",  Array<var> { wx[1], wy[1] });
+        window.getDynamicObject()->setProperty ("stride", Array<var> { wx[2], wy[2] });
+        return window;
+    }
+
+    var lod_points (var::NativeFunctionArgs args)
+    {
+        // Returns the vertex coordinates on one axis of the cells selected by
+        // a window from lod-window: count + 1 vertices, stride apart.
+        // --------------------------------------------------------------------
+        auto x      = checkArg<nd::array<double, 1>> ("lod-points", args, 0);
+        auto window = checkArg ("lod-points", args, 1);
+        auto axis   = optKeywordArg (args, "axis", 0);
+        int start   = window["start"][axis];
+        int count   = window["count"][axis];
+        int stride  = window["stride"][axis];
+        auto result = nd::array<double, 1> (count + 1);
+
+        for (int k = 0; k <= count; ++k)
+            result (k) = x (jmin (start + k * stride, int (x.size()) - 1));
+
+        return Runtime::make_data (result);
     }
 
 
     //=========================================================================
     var load_patches2d (var::NativeFunctionArgs args)
     {
+        // Patches are read concurrently, each as its own parallelFor item, but
+        // split into at most max-inflight strands that read their patches one
+        // after another, so the number of files being read at once is bounded.
+        // Each strand reads through its own serializer, so that none is
+        // shared between threads. If timing=true, the number of patches and
+        // the total, mean, and slowest read times are written to the log; the
+        // result is the same either way.
+        //
+        // If domain=[x0 x1 y0 y1] is given, only the patches intersecting it
+        // are returned; with coords='spherical' the patch vertices are taken
+        // to be (r, theta). Patches read this way are cached, so panning only
+        // reads newly exposed patches. Cached patches further than keep-margin
+        // domain widths (or heights) outside the domain are dropped.
+        // --------------------------------------------------------------------
         auto _ = nd::axis::all();
         auto bailout = optBailout (args);
+        auto parallelFor = optParallelFor (args);
         auto file = checkArg<File> ("load-patches2d", args, 0);
         auto field = checkArg<std::string> ("load-patches2d", args, 1);
         auto component = optKeywordArg (args, "component", -1);
-        auto fields = std::set<patches2d::Field> { patches2d::parse_field (field) };
+        auto maxInFlight = jmax (1, optKeywordArg (args, "max-inflight", 8));
+        auto timing = optKeywordArg (args, "timing", false);
+        auto domain = optKeywordArg<var> (args, "domain", var());
+        auto coords = optKeywordArg<String> (args, "coords", "cartesian");
+        auto keepMargin = optKeywordArg (args, "keep-margin", 1.0);
+        auto requested = patches2d::parse_field (field);
         auto ser = FileSystemSerializer (file);
-        auto db = patches2d::Database::load (ser, fields, bailout);
+        auto paths = std::vector<std::string>();
+        auto names = std::vector<std::string>();
+        auto index = SharedResourcePointer<Patches2dIndex>();
+        auto visible = std::set<std::string>();
+        auto hasDomain = domain.isArray() && domain.size() == 4;
+        auto region = Rectangle<double>();
+
+        if (coords != "cartesian" && coords != "spherical")
+        {
+            throw std::runtime_error ("coords must be 'cartesian' or 'spherical'");
+        }
+
+        if (hasDomain)
+        {
+            region = Rectangle<double>::leftTopRightBottom (domain[0], domain[2], domain[1], domain[3]);
+            visible = index->findPatches (file, region, coords == "spherical", parallelFor);
+        }
+
+        for (const auto& patch : ser.list_patches())
+            if (! hasDomain || visible.count (patch))
+                for (const auto& name : ser.list_fields (patch))
+                    if (patches2d::parse_field (name) == requested)
+                    {
+                        paths.push_back (patch + "/" + name);
+                        names.push_back (patch);
+                    }
+
+        auto numPatches = int (paths.size());
+        auto numStrands = jmin (maxInFlight, numPatches);
+        auto patches = std::vector<nd::array<double, 3>> (numPatches);
+        auto milliseconds = std::vector<double> (numPatches);
+        auto errors = std::vector<std::exception_ptr> (numStrands);
+
+        parallelFor (numStrands, [&] (int strand)
+        {
+            try {
+                auto strandSerializer = FileSystemSerializer (file);
+
+                for (int n = strand; n < numPatches; n += numStrands)
+                {
+                    if (bailout && bailout())
+                        return;
+
+                    auto start = Time::getMillisecondCounterHiRes();
+
+                    if (! hasDomain || ! index->lookupPatch (file, paths[n], patches[n]))
+                    {
+                        patches[n] = strandSerializer.read_array (paths[n]);
+
+                        if (hasDomain)
+                            index->storePatch (file, paths[n], names[n], patches[n]);
+                    }
+                    milliseconds[n] = Time::getMillisecondCounterHiRes() - start;
+                }
+            }
+            catch (...)
+            {
+                errors[strand] = std::current_exception();
+            }
+        });
+
+        for (const auto& error : errors)
+            if (error)
+                std::rethrow_exception (error);
+
+        if (bailout && bailout())
+        {
+            return var();
+        }
+
+        if (hasDomain)
+        {
+            index->dropPatchesOutside (file, region.expanded (region.getWidth() * keepMargin, region.getHeight() * keepMargin));
+        }
+
         auto res = Array<var>();
 
-        for (auto patch : db)
+        for (int n = 0; n < numPatches; ++n)
         {
+            const auto& patch = patches[n];
+
             if (component == -1)
-                res.add (Runtime::make_data (patch.second));
-            else if (component >= 0 && component < patch.second.shape(2))
-                res.add (Runtime::make_data (patch.second.select (_, _, component).copy()));
+                res.add (Runtime::make_data (patch));
+            else if (component >= 0 && component < patch.shape(2))
+                res.add (Runtime::make_data (patch.select (_, _, component).copy()));
             else
                 throw std::runtime_error ("out-of-range component");
         }
+
+        if (timing && numPatches > 0)
+        {
+            auto total = 0.0;
+            auto slowest = 0.0;
+
+            for (auto t : milliseconds)
+            {
+                total += t;
+                slowest = jmax (slowest, t);
+            }
+
+            Logger::writeToLog ("load-patches2d " + file.getFileName() + " " + String (field)
+                                + ": " + String (numPatches) + " patches, "
+                                + String (total, 1) + " ms total, "
+                                + String (total / numPatches, 2) + " ms mean, "
+                                + String (slowest, 2) + " ms slowest");
+        }
         return res;
     }
 
     var jic_energy_flux(var::NativeFunctionArgs args)
     {
         // This function computes energy fluxes for jet-in-cloud formatted data.
-        // The result is the energy flux, T-0r, multiplied to r^2.
+        // The result is the energy flux, T-0r, multiplied to r^2. Rows are
+        // computed in parallel when running on a task pool.
+        auto parallelFor = optParallelFor (args);
         auto cellCoords  = checkArgData<nd::array<double, 3>>("jic-energy-flux", args, 0);
         auto pressure    = checkArgData<nd::array<double, 2>>("jic-energy-flux", args, 1);
         auto density     = checkArgData<nd::array<double, 2>>("jic-energy-flux", args, 2);
@@ -699,7 +1473,7 @@ namespace builtin
         int nj = cellCoords.shape(1);
         auto result = nd::array<double, 2>(ni, nj);
 
-        for (int i = 0; i < ni; ++i)
+        parallelFor (ni, [&] (int i)
         {
             for (int j = 0; j < nj; ++j)
             {
@@ -714,7 +1488,7 @@ namespace builtin
                 double dLdOmega = T0r * r * r;// * std::sin(q);
                 result (i, j) = dLdOmega;
             }
-        }
+        });
         return Runtime::make_data (result);
     }
 }
@@ -723,6 +1497,22 @@ namespace builtin
 
 
 // ============================================================================
+struct Runtime::BuiltinCaches::Holder
+{
+    SharedResourcePointer<builtin::TailedTextTables> tailedTextTables;
+    SharedResourcePointer<Patches2dIndex> patches2dIndex;
+    SharedResourcePointer<HDF5SeriesCache> hdf5SeriesCache;
+    SharedResourcePointer<TextTableCache> textTableCache;
+};
+
+Runtime::BuiltinCaches::BuiltinCaches() : holder (std::make_unique<Holder>())
+{
+}
+
+Runtime::BuiltinCaches::~BuiltinCaches()
+{
+}
+
 void Runtime::load_builtins (Kernel& kernel)
 {
     kernel.insert ("list",           var::NativeFunction (builtin::list),           Flags::builtin);
@@ -751,10 +1541,152 @@ void Runtime::load_builtins (Kernel& kernel)
     kernel.insert ("trimesh",        var::NativeFunction (builtin::trimesh),        Flags::builtin);
     kernel.insert ("gradient",       var::NativeFunction (builtin::gradient),       Flags::builtin);
     kernel.insert ("load-text",      var::NativeFunction (builtin::load_text),      Flags::builtin);
+    kernel.insert ("load-npy",       var::NativeFunction (builtin::load_npy),       Flags::builtin);
+    kernel.insert ("load-npz",       var::NativeFunction (builtin::load_npz),       Flags::builtin);
     kernel.insert ("load-hdf5",      var::NativeFunction (builtin::load_hdf5),      Flags::builtin);
+    kernel.insert ("load-series",    var::NativeFunction (builtin::load_series),    Flags::builtin);
     kernel.insert ("load-patches2d", var::NativeFunction (builtin::load_patches2d), Flags::builtin);
+    kernel.insert ("lod-window",     var::NativeFunction (builtin::lod_window),     Flags::builtin);
+    kernel.insert ("lod-points",     var::NativeFunction (builtin::lod_points),     Flags::builtin);
     kernel.insert ("jic-energy-flux", var::NativeFunction (builtin::jic_energy_flux), Flags::builtin);
 
     kernel.insert ("to-gpu-triangulate", var::NativeFunction (builtin::to_gpu_triangulate), Flags::builtin);
     kernel.insert ("to-gpu",             var::NativeFunction (builtin::to_gpu),             Flags::builtin);
 }
+
+
+
+
+//=============================================================================
+const var& Runtime::KernelSnapshot::at (const std::string& key) const
+{
+    if (scope == nullptr)
+    {
+        throw std::out_of_range ("empty kernel snapshot");
+    }
+    auto cell = scope->find (key);
+
+    if (cell != scope->end())
+    {
+        return cell->second->value;
+    }
+    if (builtins != nullptr)
+    {
+        return builtins->at (key)->value;
+    }
+    return scope->at (key)->value;
+}
+
+var Runtime::KernelSnapshot::resolve (std::string& error, const VarCallAdapter& adapter) const
+{
+    return resolve (rule, error, adapter);
+}
+
+var Runtime::KernelSnapshot::resolve (const std::string& key, std::string& error, const VarCallAdapter& adapter) const
+{
+    try {
+        return scope->at (key)->expr.resolve<var> (*this, adapter);
+    }
+    catch (const std::exception& e)
+    {
+        error = e.what();
+    }
+    return var();
+}
+
+Runtime::KernelSnapshot Runtime::KernelSnapshot::withValue (const std::string& key, const var& value) const
+{
+    auto result = *this;
+    auto newScope = std::make_shared<Scope> (*scope);
+    auto& cell = (*newScope)[key];
+
+    cell = std::make_shared<const Cell> (Cell { cell ? cell->expr : crt::expression(), value });
+    result.scope = newScope;
+    return result;
+}
+
+
+
+
+//=============================================================================
+Runtime::KernelSnapshot Runtime::SnapshotCache::take (const Kernel& kernel, const std::string& rule)
+{
+    return take (kernel, std::vector<std::string> { rule });
+}
+
+Runtime::KernelSnapshot Runtime::SnapshotCache::take (const Kernel& kernel, const std::vector<std::string>& rules)
+{
+    auto snapshot = KernelSnapshot();
+    auto scope = std::make_shared<KernelSnapshot::Scope>();
+
+    snapshot.rule = rules.front();
+
+    for (const auto& rule : rules)
+    {
+        (*scope)[rule] = cellFor (kernel, rule, snapshot.bytesCopied);
+
+        for (const auto& key : kernel.upstream (rule))
+            if (kernel.contains (key) && (kernel.flags_at (key) & Flags::builtin) == 0)
+                (*scope)[key] = cellFor (kernel, key, snapshot.bytesCopied);
+    }
+
+    // Builtins never change, so they are gathered into a scope once and
+    // shared by every snapshot; this way a snapshot also does not depend on
+    // whether they are listed as upstream.
+    // ------------------------------------------------------------------------
+    if (builtins == nullptr)
+    {
+        auto builtinScope = std::make_shared<KernelSnapshot::Scope>();
+        auto bytesCopied = std::size_t (0);
+
+        for (const auto& item : kernel)
+            if (item.second.flags & Flags::builtin)
+                (*builtinScope)[item.first] = cellFor (kernel, item.first, bytesCopied);
+
+        builtins = builtinScope;
+    }
+
+    snapshot.bytesCopied += scope->size() * (sizeof (KernelSnapshot::Scope::value_type) + sizeof (void*));
+    snapshot.scope = scope;
+    snapshot.builtins = builtins;
+    return snapshot;
+}
+
+void Runtime::SnapshotCache::clear()
+{
+    cells.clear();
+    builtins = nullptr;
+}
+
+std::shared_ptr<const Runtime::KernelSnapshot::Cell> Runtime::SnapshotCache::cellFor (const Kernel& kernel,
+                                                                                    const std::string& key,
+                                                                                    std::size_t& bytesCopied)
+{
+    const auto& value = kernel.at (key);
+    const auto& expr = kernel.expr_at (key);
+    auto& cell = cells[key];
+
+    if (cell == nullptr || cell->expr != expr || ! isSameValue (cell->value, value))
+    {
+        cell = std::make_shared<const KernelSnapshot::Cell> (KernelSnapshot::Cell { expr, value });
+        bytesCopied += sizeof (KernelSnapshot::Cell) + expr.str().size();
+    }
+    return cell;
+}
+
+bool Runtime::SnapshotCache::isSameValue (const var& a, const var& b)
+{
+    // A rule whose value changes gets a new array or object, so comparing
+    // identities is enough, and costs nothing however large the data is.
+    // ------------------------------------------------------------------------
+    if (a.isArray() || b.isArray())
+    {
+        return a.getArray() == b.getArray();
+    }
+    if (a.isObject() || b.isObject())
+    {
+        return a.getObject() == b.getObject();
+    }
+    return a.equalsWithSameType (b);
+}
+
@@ -15,22 +15,41 @@ public:
     using list_t = std::vector<ObjectType>;
     using dict_t = std::unordered_map<std::string, ObjectType>;
     using func_t = std::function<ObjectType(list_t, dict_t)>;
+    using Executor = std::function<void(int, std::function<void(int)>, std::function<bool()>)>;
 
 
     //=========================================================================
+    /**
+     * Passed to builtin functions under argkey. Besides the bailout callback,
+     * it may carry an executor, which builtins use to split their work into
+     * child items that share the callback; the executor stops starting items
+     * once the callback returns true.
+     */
     struct BailoutChecker : public ReferenceCountedObject
     {
         static Identifier argkey;
-        BailoutChecker (std::function<bool()> callback) : callback (callback) {}
+        BailoutChecker (std::function<bool()> callback, Executor executor=nullptr)
+        : callback (callback)
+        , executor (executor) {}
+
+        void parallelFor (int numItems, std::function<void(int)> body) const
+        {
+            if (executor)
+                executor (numItems, body, callback);
+            else
+                for (int n = 0; n < numItems && ! callback(); ++n)
+                    body (n);
+        }
         std::function<bool()> callback;
+        Executor executor;
     };
 
 
     //=========================================================================
     VarCallAdapter() {}
-    VarCallAdapter (std::function<bool()> callback)
+    VarCallAdapter (std::function<bool()> callback, Executor executor=nullptr)
     : bailout (callback)
-    , bailoutVar (new BailoutChecker (callback)) {}
+    , bailoutVar (new BailoutChecker (callback, executor)) {}
 
 
     //=========================================================================
@@ -118,6 +137,25 @@ public:
     static void load_builtins (Kernel& kernel);
 
 
+    //=========================================================================
+    /**
+     * Keeps the caches that builtins share between calls alive for as long as
+     * it exists. The builtins reach those caches through SharedResourcePointer,
+     * so if nothing else held them, each would be created and destroyed again
+     * on every call. Whatever evaluates kernels with the builtins loaded
+     * should own one of these.
+     */
+    class BuiltinCaches
+    {
+    public:
+        BuiltinCaches();
+        ~BuiltinCaches();
+    private:
+        struct Holder;
+        std::unique_ptr<Holder> holder;
+    };
+
+
     //=========================================================================
     template<typename> class DataTypeInfo {};
 
@@ -126,8 +164,32 @@ public:
     class GenericData : public ReferenceCountedObject
     {
     public:
+        GenericData() : serial (nextSerial()) {}
+
+        /**
+         * A number unique to this object for the life of the process, so that
+         * it can be told apart from objects later made at the same address,
+         * without being kept alive.
+         */
+        const uint64 serial;
+
         virtual std::string name() = 0;
         virtual std::string summary() = 0;
+        virtual std::size_t bytes() = 0;
+
+        /**
+         * Compute the value now, if it is computed on demand. Async tasks call
+         * this on their results, so the work is not left to whichever rule
+         * (possibly a synchronous one, on the message thread) reads it first.
+         */
+        virtual void force() {}
+
+    private:
+        static uint64 nextSerial()
+        {
+            static std::atomic<uint64> counter (0);
+            return ++counter;
+        }
     };
 
 
@@ -140,11 +202,139 @@ public:
         Data (const T& value) : value (value) {}
         std::string name() override { return DataTypeInfo<T>::name(); }
         std::string summary() override { return DataTypeInfo<T>::summary (value); }
+        std::size_t bytes() override { return DataTypeInfo<T>::bytes (value); }
         T value;
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Data)
     };
 
 
+    //=========================================================================
+    /**
+     * Data whose value is only computed the first time something asks for it
+     * through check_data or opt_data, or when it is forced. The load function
+     * may be called from any thread; it is called at most once unless it
+     * throws. The value is not changed once loaded, so summary and bytes read
+     * it without taking the lock, and never wait on a load in progress.
+     */
+    template<typename T>
+    struct LazyData : public GenericData
+    {
+    public:
+        LazyData (std::function<T()> load) : load (load) {}
+        std::string name() override { return DataTypeInfo<T>::name(); }
+        std::string summary() override
+        {
+            return loaded ? DataTypeInfo<T>::summary (value) : DataTypeInfo<T>::name() + " (not loaded)";
+        }
+        std::size_t bytes() override
+        {
+            return loaded ? DataTypeInfo<T>::bytes (value) : 0;
+        }
+        void force() override
+        {
+            get();
+        }
+        T& get()
+        {
+            if (! loaded)
+            {
+                const ScopedLock sl (lock);
+
+                if (! loaded)
+                {
+                    value = load();
+                    loaded = true;
+                }
+            }
+            return value;
+        }
+    private:
+        std::function<T()> load;
+        CriticalSection lock;
+        std::atomic<bool> loaded { false };
+        T value;
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LazyData)
+    };
+
+
+    //=========================================================================
+    class SnapshotCache;
+
+    /**
+     * An immutable view of the part of a kernel needed to resolve one rule. It
+     * is meant to be handed to a worker thread in place of a full copy of the
+     * kernel. Snapshots are made by a SnapshotCache, and refer to shared,
+     * read-only cells, so the kernel owner can keep mutating its kernel while
+     * any number of snapshots are in flight.
+     */
+    class KernelSnapshot
+    {
+    public:
+        struct Cell
+        {
+            crt::expression expr;
+            var value;
+        };
+        using Scope = std::unordered_map<std::string, std::shared_ptr<const Cell>>;
+
+        KernelSnapshot() {}
+        const var& at (const std::string& key) const;
+        var resolve (std::string& error, const VarCallAdapter& adapter) const;
+        var resolve (const std::string& key, std::string& error, const VarCallAdapter& adapter) const;
+
+        /**
+         * Return a snapshot in which the given rule has a new value. All other
+         * cells are shared with this one. This is how a pipeline of rules hands
+         * results from one stage to the next without consulting the kernel.
+         */
+        KernelSnapshot withValue (const std::string& key, const var& value) const;
+        const std::string& getRule() const { return rule; }
+
+        /**
+         * Return an estimate of the bytes this snapshot allocated: its scope
+         * entries, and the cells (not the values in them) it had to create.
+         */
+        std::size_t getNumBytesCopied() const { return bytesCopied; }
+
+    private:
+        friend class SnapshotCache;
+        std::string rule;
+        std::shared_ptr<const Scope> scope;
+        std::shared_ptr<const Scope> builtins;
+        std::size_t bytesCopied = 0;
+    };
+
+
+    //=========================================================================
+    /**
+     * Keeps one shared cell per kernel rule. A cell is only re-created when the
+     * kernel's value or expression for that rule has changed since the last
+     * snapshot was taken, so successive snapshots share all unchanged cells.
+     * Values are compared by identity where they refer to shared data (arrays
+     * and objects), so taking a snapshot never compares array contents. The
+     * builtins are gathered into one scope that every snapshot shares, until
+     * the cache is cleared. This class must only be used from the thread that
+     * owns the kernel.
+     */
+    class SnapshotCache
+    {
+    public:
+        KernelSnapshot take (const Kernel& kernel, const std::string& rule);
+
+        /**
+         * Take a snapshot containing all of the given rules and their upstream
+         * values. The first rule becomes the snapshot's rule.
+         */
+        KernelSnapshot take (const Kernel& kernel, const std::vector<std::string>& rules);
+        void clear();
+    private:
+        std::shared_ptr<const KernelSnapshot::Cell> cellFor (const Kernel& kernel, const std::string& key, std::size_t& bytesCopied);
+        static bool isSameValue (const var& a, const var& b);
+        KernelSnapshot::Scope cells;
+        std::shared_ptr<const KernelSnapshot::Scope> builtins;
+    };
+
+
     //=========================================================================
     static std::runtime_error make_type_error (const std::string& expected,
                                                const var& value,
@@ -173,6 +363,12 @@ public:
         return new Data<T> (value);
     }
 
+    template<typename T>
+    static var make_lazy_data (std::function<T()> load)
+    {
+        return new LazyData<T> (load);
+    }
+
     static std::string type_name (const var& value)
     {
         if (auto data = dynamic_cast<GenericData*> (value.getObject()))
@@ -191,6 +387,10 @@ public:
         {
             return result->value;
         }
+        if (auto result = dynamic_cast<LazyData<T>*> (value.getObject()))
+        {
+            return result->get();
+        }
         throw make_type_error<T> (value, caller, index);
     }
 
@@ -201,9 +401,50 @@ public:
         {
             return &data->value;
         }
+        if (auto data = dynamic_cast<LazyData<T>*> (value.getObject()))
+        {
+            return &data->get();
+        }
         return nullptr;
     }
 
+    /**
+     * Force any lazily computed data in the value, including inside lists.
+     */
+    static void force_data (const var& value)
+    {
+        if (auto data = dynamic_cast<GenericData*> (value.getObject()))
+        {
+            data->force();
+        }
+        else if (auto arr = value.getArray())
+        {
+            for (const auto& element : *arr)
+                force_data (element);
+        }
+    }
+
+    static std::size_t size_in_bytes (const var& value)
+    {
+        if (auto data = dynamic_cast<GenericData*> (value.getObject()))
+        {
+            return data->bytes();
+        }
+        if (auto arr = value.getArray())
+        {
+            std::size_t result = sizeof (var);
+
+            for (const auto& element : *arr)
+                result += size_in_bytes (element);
+            return result;
+        }
+        if (value.isString())
+        {
+            return sizeof (var) + value.toString().getNumBytesAsUTF8();
+        }
+        return sizeof (var);
+    }
+
     static String represent (const var& value)
     {
         if (auto result = dynamic_cast<GenericData*> (value.getObject()))
@@ -242,6 +483,7 @@ public:
         auto ni = std::to_string (A.shape(0));
         return "double[" + ni + "]";
     }
+    static std::size_t bytes (const nd::array<double, 1>& A) { return A.size() * sizeof (double); }
 };
 
 //=============================================================================
@@ -256,6 +498,7 @@ public:
         auto nj = std::to_string (A.shape(1));
         return "double[" + ni + ", " + nj + "]";
     }
+    static std::size_t bytes (const nd::array<double, 2>& A) { return A.size() * sizeof (double); }
 };
 
 //=============================================================================
@@ -271,6 +514,52 @@ public:
         auto nk = std::to_string (A.shape(2));
         return "double[" + ni + ", " + nj + ", " + nk + "]";
     }
+    static std::size_t bytes (const nd::array<double, 3>& A) { return A.size() * sizeof (double); }
+};
+
+//=============================================================================
+template<>
+class Runtime::DataTypeInfo<nd::array<float, 1>>
+{
+public:
+    static std::string name() { return "nd::array<float, 1>"; }
+    static std::string summary (const nd::array<float, 1>& A)
+    {
+        auto ni = std::to_string (A.shape(0));
+        return "float[" + ni + "]";
+    }
+    static std::size_t bytes (const nd::array<float, 1>& A) { return A.size() * sizeof (float); }
+};
+
+//=============================================================================
+template<>
+class Runtime::DataTypeInfo<nd::array<float, 2>>
+{
+public:
+    static std::string name() { return "nd::array<float, 2>"; }
+    static std::string summary (const nd::array<float, 2>& A)
+    {
+        auto ni = std::to_string (A.shape(0));
+        auto nj = std::to_string (A.shape(1));
+        return "float[" + ni + ", " + nj + "]";
+    }
+    static std::size_t bytes (const nd::array<float, 2>& A) { return A.size() * sizeof (float); }
+};
+
+//=============================================================================
+template<>
+class Runtime::DataTypeInfo<nd::array<float, 3>>
+{
+public:
+    static std::string name() { return "nd::array<float, 3>"; }
+    static std::string summary (const nd::array<float, 3>& A)
+    {
+        auto ni = std::to_string (A.shape(0));
+        auto nj = std::to_string (A.shape(1));
+        auto nk = std::to_string (A.shape(2));
+        return "float[" + ni + ", " + nj + ", " + nk + "]";
+    }
+    static std::size_t bytes (const nd::array<float, 3>& A) { return A.size() * sizeof (float); }
 };
 
 //=============================================================================
@@ -280,6 +569,7 @@ class Runtime::DataTypeInfo<Array<Colour>>
 public:
     static std::string name() { return "Array<Colour>"; }
     static std::string summary (const Array<Colour>& A) { return "color[" + std::to_string (A.size()) + "]"; }
+    static std::size_t bytes (const Array<Colour>& A) { return A.size() * sizeof (Colour); }
 };
 
 //=============================================================================
@@ -289,6 +579,7 @@ class Runtime::DataTypeInfo<std::shared_ptr<PlotArtist>>
 public:
     static std::string name() { return "std::shared_ptr<PlotArtist>"; }
     static std::string summary (const std::shared_ptr<PlotArtist>& A) { return "PlotArtist"; }
+    static std::size_t bytes (const std::shared_ptr<PlotArtist>& A) { return sizeof (PlotArtist); }
 };
 
 //=============================================================================
@@ -301,6 +592,7 @@ public:
     {
         return "mapping(" + std::to_string (A.vmin) + " -> " + std::to_string (A.vmax) + ")";
     }
+    static std::size_t bytes (const ScalarMapping& A) { return sizeof (ScalarMapping) + A.stops.size() * sizeof (Colour); }
 };
 
 //=============================================================================
@@ -310,6 +602,7 @@ class Runtime::DataTypeInfo<DeviceBufferFloat1>
 public:
     static std::string name() { return "DeviceBufferFloat1"; }
     static std::string summary (const DeviceBufferFloat1& A) { return "device::float1[" + std::to_string (A.size) + "]"; }
+    static std::size_t bytes (const DeviceBufferFloat1& A) { return A.size * sizeof (simd::float1); }
 };
 
 //=============================================================================
@@ -319,6 +612,7 @@ class Runtime::DataTypeInfo<DeviceBufferFloat2>
 public:
     static std::string name() { return "DeviceBufferFloat2"; }
     static std::string summary (const DeviceBufferFloat2& A) { return "device::float2[" + std::to_string (A.size) + "]"; }
+    static std::size_t bytes (const DeviceBufferFloat2& A) { return A.size * sizeof (simd::float2); }
 };
 
 //=============================================================================
@@ -328,4 +622,5 @@ class Runtime::DataTypeInfo<DeviceBufferFloat4>
 public:
     static std::string name() { return "DeviceBufferFloat4"; }
     static std::string summary (const DeviceBufferFloat4& A) { return "device::float4[" + std::to_string (A.size) + "]"; }
+    static std::size_t bytes (const DeviceBufferFloat4& A) { return A.size * sizeof (simd::float4); }
 };
@@ -4,48 +4,162 @@
 
 
 //=========================================================================
-TaskPool::Job::Job (TaskPool& taskPool, const String& name, Task task)
-: ThreadPoolJob (name)
-, taskPool (taskPool)
-, task (task)
+TaskPool::SharedExecutor::SharedExecutor() : threadPool (SystemStats::getNumCpus())
+{
+}
+
+TaskPool::SharedExecutor::~SharedExecutor()
+{
+    threadPool.removeAllJobs (true, 4000);
+}
+
+void TaskPool::SharedExecutor::add (Pending task)
+{
+    task.enqueueTime = Time::getMillisecondCounter();
+    {
+        const ScopedLock sl (lock);
+        pending.push_back (task);
+    }
+    threadPool.addJob (new Job (*this), true);
+}
+
+bool TaskPool::SharedExecutor::take (Job& job, Pending& task)
+{
+    const ScopedLock sl (lock);
+
+    if (pending.empty())
+    {
+        return false;
+    }
+
+    // Urgency is measured in milliseconds of waiting: each priority level is
+    // worth agingIntervalMs. Ties go to the task that was enqueued first.
+    // Viewers compete on equal terms; only priority and age matter.
+    // ------------------------------------------------------------------------
+    auto now = Time::getMillisecondCounter();
+    auto urgency = [now] (const Pending& entry) -> int64
+    {
+        if (entry.item)
+            return std::numeric_limits<int64>::max();
+        return int64 (entry.priority) * agingIntervalMs + int64 (now - entry.enqueueTime);
+    };
+
+    auto next = pending.begin();
+
+    for (auto entry = pending.begin(); entry != pending.end(); ++entry)
+        if (urgency (*entry) > urgency (*next))
+            next = entry;
+
+    task = *next;
+    pending.erase (next);
+
+    if (! task.item)
+    {
+        job.owner = task.owner;
+        job.taskName = task.name;
+        running.push_back ({ task.owner, task.name });
+    }
+    return true;
+}
+
+void TaskPool::SharedExecutor::removeRunning (const TaskPool* owner, const String& name)
+{
+    const ScopedLock sl (lock);
+
+    for (auto item = running.begin(); item != running.end(); ++item)
+    {
+        if (item->first == owner && item->second == name)
+        {
+            running.erase (item);
+            return;
+        }
+    }
+}
+
+
+
+
+//=========================================================================
+TaskPool::Job::Job (SharedExecutor& executor)
+: ThreadPoolJob ("TaskPool::Job")
+, executor (executor)
 {
 }
 
 ThreadPoolJob::JobStatus TaskPool::Job::runJob()
 {
+    auto task = Pending();
+
+    if (! executor.take (*this, task))
+    {
+        return jobHasFinished;
+    }
+
+    if (task.item)
+    {
+        task.item();
+        return jobHasFinished;
+    }
+
+    auto& taskPool = *task.owner;
+
     try {
-        taskPool.indicateJobStarted (getJobName());
-        auto result = task ([this] { return shouldExit(); });
-        return taskPool.notify (getJobName(), result, std::string(), ! shouldExit());
+        taskPool.indicateJobStarted (task.name);
+        auto bailout = [this] { return shouldExit(); };
+        auto publisher = [this, &taskPool, name = task.name] (const var& message)
+        {
+            if (! shouldExit())
+                taskPool.publish (name, message);
+        };
+        auto result = task.task (bailout, publisher);
+        executor.removeRunning (&taskPool, task.name);
+        return taskPool.notify (task.name, result, std::string(), ! shouldExit());
     }
     catch (const std::exception& e)
     {
-        return taskPool.notify (getJobName(), var(), e.what(), ! shouldExit());
+        executor.removeRunning (&taskPool, task.name);
+        return taskPool.notify (task.name, var(), e.what(), ! shouldExit());
     }
 }
 
+bool TaskPool::Job::isRunningTaskOf (const TaskPool* taskPool, const String* name) const
+{
+    const ScopedLock sl (executor.lock);
+    return owner == taskPool && (name == nullptr || taskName == *name);
+}
+
 
 
 
 //=========================================================================
-TaskPool::Selector::Selector (const String& name) : name (name)
+TaskPool::Selector::Selector (const TaskPool* owner) : owner (owner), anyName (true)
+{
+}
+
+TaskPool::Selector::Selector (const TaskPool* owner, const String& name) : owner (owner), name (name), anyName (false)
 {
 }
 
 bool TaskPool::Selector::isJobSuitable (ThreadPoolJob* job)
 {
-    return job->getJobName() == name;
+    if (auto j = dynamic_cast<Job*> (job))
+        return j->isRunningTaskOf (owner, anyName ? nullptr : &name);
+    return false;
 }
 
 
 
 
 //=========================================================================
-TaskPool::TaskPool (int numThreads) : threadPool (numThreads) {}
+TaskPool::TaskPool() {}
 
 TaskPool::~TaskPool()
 {
-    threadPool.removeAllJobs (true, 4000);
+    cancelAll();
+
+    Selector jobsToWaitFor (this);
+    executor->threadPool.removeAllJobs (true, 4000, &jobsToWaitFor);
+    cancelPendingUpdate();
 }
 
 void TaskPool::addListener (Listener* listener)
@@ -58,58 +172,242 @@ void TaskPool::removeListener (Listener* listener)
     listeners.remove (listener);
 }
 
-void TaskPool::enqueue (const String& name, Task task)
+void TaskPool::enqueue (const String& name, Task task, Priority priority)
 {
-    Selector jobsToRemove (name);
-    threadPool.removeAllJobs (true, 0, &jobsToRemove);
-    threadPool.addJob (new Job (*this, name, task), true);
+    enqueuePipeline (name, [task] (auto bailout, auto) { return task (bailout); }, priority);
+}
+
+void TaskPool::enqueuePipeline (const String& name, PipelineTask task, Priority priority)
+{
+    cancel (name);
+
+    auto entry = Pending();
+    entry.owner = this;
+    entry.name = name;
+    entry.task = task;
+    entry.priority = priority;
+    executor->add (entry);
+}
+
+void TaskPool::setPriority (const String& name, Priority priority)
+{
+    const ScopedLock sl (executor->lock);
+
+    for (auto& entry : executor->pending)
+        if (! entry.item && entry.owner == this && entry.name == name)
+            entry.priority = priority;
 }
 
 void TaskPool::cancel (const String& name)
 {
-    Selector jobsToRemove (name);
-    threadPool.removeAllJobs (true, 0, &jobsToRemove);
+    // Queued tasks are simply dropped; their jobs will find nothing to do.
+    // ------------------------------------------------------------------------
+    {
+        const ScopedLock sl (executor->lock);
+        auto& pending = executor->pending;
+
+        pending.erase (std::remove_if (pending.begin(), pending.end(), [this, &name] (const auto& entry)
+        {
+            return ! entry.item && entry.owner == this && entry.name == name;
+        }), pending.end());
+    }
+    Selector jobsToRemove (this, name);
+    executor->threadPool.removeAllJobs (true, 0, &jobsToRemove);
 }
 
 void TaskPool::cancelAll()
 {
-    threadPool.removeAllJobs (true, 0);
+    // Only this pool's tasks are affected; other pools sharing the executor
+    // keep running. parallelFor items are left in place, since the thread
+    // that called parallelFor picks up any items nobody else has claimed.
+    // ------------------------------------------------------------------------
+    {
+        const ScopedLock sl (executor->lock);
+        auto& pending = executor->pending;
+
+        pending.erase (std::remove_if (pending.begin(), pending.end(), [this] (const auto& entry)
+        {
+            return ! entry.item && entry.owner == this;
+        }), pending.end());
+    }
+    Selector jobsToRemove (this);
+    executor->threadPool.removeAllJobs (true, 0, &jobsToRemove);
 }
 
 int TaskPool::getNumJobsRunningOrQueued() const
 {
-    return threadPool.getNumJobs();
+    const ScopedLock sl (executor->lock);
+    int result = 0;
+
+    for (const auto& entry : executor->pending)
+        if (! entry.item && entry.owner == this)
+            ++result;
+
+    for (const auto& item : executor->running)
+        if (item.first == this)
+            ++result;
+
+    return result;
+}
+
+void TaskPool::parallelFor (int numItems, std::function<void(int)> body, BailoutChecker bailout)
+{
+    struct State
+    {
+        std::atomic<int> next { 0 };
+        std::atomic<int> done { 0 };
+        std::atomic<bool> failed { false };
+        int count = 0;
+        std::function<void(int)> body;
+        BailoutChecker bailout;
+        std::exception_ptr exception;
+        WaitableEvent finished;
+    };
+
+    if (numItems <= 0)
+        return;
+
+    auto state = std::make_shared<State>();
+    state->count = numItems;
+    state->body = body;
+    state->bailout = bailout;
+
+    // Items that are claimed after a failure or a bailout are counted as done
+    // without being run, so the caller is released as soon as the items that
+    // were already running have finished.
+    // ------------------------------------------------------------------------
+    auto work = [state]
+    {
+        for (int n = state->next++; n < state->count; n = state->next++)
+        {
+            if (! state->failed && ! (state->bailout && state->bailout()))
+            {
+                try {
+                    state->body (n);
+                }
+                catch (...)
+                {
+                    if (! state->failed.exchange (true))
+                        state->exception = std::current_exception();
+                }
+            }
+            if (++state->done == state->count)
+                state->finished.signal();
+        }
+    };
+
+    for (int n = 1; n < jmin (numItems, executor->threadPool.getNumThreads() + 1); ++n)
+    {
+        auto entry = Pending();
+        entry.item = work;
+        executor->add (entry);
+    }
+
+    work();
+    state->finished.wait();
+
+    if (state->exception)
+        std::rethrow_exception (state->exception);
+}
+
+TaskPool::Executor TaskPool::getExecutor()
+{
+    return [this] (int numItems, std::function<void(int)> body, BailoutChecker bailout)
+    {
+        parallelFor (numItems, body, bailout);
+    };
+}
+
+bool TaskPool::isRunningOrQueued (const String& name) const
+{
+    const ScopedLock sl (executor->lock);
+
+    for (const auto& entry : executor->pending)
+        if (! entry.item && entry.owner == this && entry.name == name)
+            return true;
+
+    for (const auto& item : executor->running)
+        if (item.first == this && item.second == name)
+            return true;
+
+    return false;
+}
+
+int TaskPool::getNumTasksQueued (Priority priority) const
+{
+    const ScopedLock sl (executor->lock);
+    int result = 0;
+
+    for (const auto& entry : executor->pending)
+        if (! entry.item && entry.owner == this && entry.priority == priority)
+            ++result;
+
+    return result;
 }
 
 
 
 
 //=========================================================================
-ThreadPoolJob::JobStatus TaskPool::notify (String name, var result, std::string error, bool completed)
+void TaskPool::handleAsyncUpdate()
+{
+    auto batch = std::vector<Notification>();
+    {
+        const ScopedLock lock (notificationLock);
+        batch.swap (notifications);
+    }
+
+    for (const auto& n : batch)
+    {
+        switch (n.type)
+        {
+            case Notification::Type::started:   listeners.call (&Listener::taskStarted, n.name); break;
+            case Notification::Type::completed: listeners.call (&Listener::taskCompleted, n.name, n.result, n.error); break;
+            case Notification::Type::cancelled: listeners.call (&Listener::taskCancelled, n.name); break;
+            case Notification::Type::published: listeners.call (&Listener::taskPublished, n.name, n.result); break;
+        }
+    }
+
+    if (! batch.empty())
+    {
+        listeners.call (&Listener::taskBatchDelivered);
+    }
+}
+
+void TaskPool::post (Notification notification)
 {
-    MessageManager::callAsync ([this, name, result, error, completed]
     {
-        if (completed)
-            listeners.call (&Listener::taskCompleted, name, result, error);
-        else
-            listeners.call (&Listener::taskCancelled, name);
-    });
+        const ScopedLock lock (notificationLock);
+        notifications.push_back (notification);
+    }
+    triggerAsyncUpdate();
+}
+
+ThreadPoolJob::JobStatus TaskPool::notify (String name, var result, std::string error, bool completed)
+{
+    if (completed)
+        post ({ Notification::Type::completed, name, result, error });
+    else
+        post ({ Notification::Type::cancelled, name, var(), std::string() });
+
     return ThreadPoolJob::jobHasFinished;
 }
 
 void TaskPool::indicateJobStarted (String name)
 {
-    MessageManager::callAsync ([this, name]
-    {
-        listeners.call (&Listener::taskStarted, name);
-    });
+    post ({ Notification::Type::started, name, var(), std::string() });
+}
+
+void TaskPool::publish (String name, var message)
+{
+    post ({ Notification::Type::published, name, message, std::string() });
 }
 
 
 
 
 //=========================================================================
-TaskPoolTestComponent::TaskPoolTestComponent() : pool (4)
+TaskPoolTestComponent::TaskPoolTestComponent()
 {
     pool.addListener (this);
 
@@ -17,15 +17,49 @@
  * gets invoked with the task name. When a task completes successfully,
  * Listener::taskCompleted gets invoked with the name of the task and the
  * resulting var.
+ *
+ * Pipeline tasks additionally receive a Publisher, which they may call any
+ * number of times with intermediate results. Each published var is delivered
+ * to Listener::taskPublished on the message thread, unless the task has been
+ * cancelled by then.
+ *
+ * All task pools in the process share one executor, with a thread per CPU;
+ * a TaskPool is a cancellation scope on it (e.g. one per viewer). Names only
+ * need to be unique within a pool, and cancelling a pool's tasks leaves the
+ * tasks of other pools alone.
+ *
+ * Tasks carry a priority. The executor's threads always start the most urgent
+ * queued task, but a queued task is promoted by one level for each second it
+ * has waited, so low priority tasks are not starved by a steady stream of
+ * high priority ones. Items spawned by parallelFor from a running task are
+ * started before any queued task.
+ *
+ * Notifications from the worker threads are queued, and delivered to the
+ * listeners in batches, once per message loop iteration. After each batch,
+ * Listener::taskBatchDelivered is called, so a listener can defer expensive
+ * work (such as re-resolving a kernel) until all the tasks that finished in
+ * the meantime have been accounted for.
  */
-class TaskPool
+class TaskPool : private AsyncUpdater
 {
 public:
 
 
     //=========================================================================
     using BailoutChecker = std::function<bool()>;
+    using Publisher = std::function<void(const var&)>;
     using Task = std::function<var(BailoutChecker)>;
+    using PipelineTask = std::function<var(BailoutChecker, Publisher)>;
+    using Executor = std::function<void(int, std::function<void(int)>, BailoutChecker)>;
+
+
+    //=========================================================================
+    enum Priority
+    {
+        low    = 0,
+        normal = 1,
+        high   = 2,
+    };
 
 
     //=========================================================================
@@ -36,11 +70,13 @@ public:
         virtual void taskStarted (const String& taskName) = 0;
         virtual void taskCompleted (const String& taskName, const var& result, const std::string& error) = 0;
         virtual void taskCancelled (const String& taskName) = 0;
+        virtual void taskPublished (const String& taskName, const var& message) {}
+        virtual void taskBatchDelivered() {}
     };
 
 
     //=========================================================================
-    TaskPool (int numThreads=1);
+    TaskPool();
     ~TaskPool();
     void addListener (Listener* listener);
     void removeListener (Listener* listener);
@@ -50,7 +86,20 @@ public:
      * Add a task to the queue with the given name. Cancels any earlier tasks
      * with the same name.
      */
-    void enqueue (const String& name, Task task);
+    void enqueue (const String& name, Task task, Priority priority=normal);
+
+
+    /**
+     * Same as above, for a task that publishes intermediate results.
+     */
+    void enqueuePipeline (const String& name, PipelineTask task, Priority priority=normal);
+
+
+    /**
+     * Change the priority of a queued task. This has no effect if the task
+     * has already started.
+     */
+    void setPriority (const String& name, Priority priority);
 
 
     /**
@@ -73,17 +122,95 @@ public:
     int getNumJobsRunningOrQueued() const;
 
 
+    /**
+     * Return true if a job with the given name is running or queued.
+     */
+    bool isRunningOrQueued (const String& name) const;
+
+
+    /**
+     * Return the number of tasks of the given priority that are waiting for
+     * a thread.
+     */
+    int getNumTasksQueued (Priority priority) const;
+
+
+    /**
+     * Invoke body (n) for n in [0, numItems), spreading the calls over the
+     * pool's threads, and return when all calls have finished. The calling
+     * thread takes part in the work, so this never waits on jobs that are
+     * only queued, even if every thread is busy with a long-running task.
+     * Idle threads steal the next unclaimed item, so uneven items balance
+     * out. This may be called from inside a running task, in which case the
+     * task's bailout checker should be passed: once it returns true, no
+     * further items are started. If a call to body throws, no further items
+     * are started either, and the first exception is rethrown here.
+     */
+    void parallelFor (int numItems, std::function<void(int)> body, BailoutChecker bailout=nullptr);
+
+
+    /**
+     * Return a function that forwards to parallelFor on this pool. It can be
+     * handed to code that only knows about the Executor signature, such as
+     * builtin functions reached through a VarCallAdapter.
+     */
+    Executor getExecutor();
+
+
 private:
 
 
     //=========================================================================
+    class Job;
+
+    struct Pending
+    {
+        TaskPool* owner = nullptr;
+        String name;
+        PipelineTask task;
+        std::function<void()> item;
+        Priority priority = normal;
+        uint32 enqueueTime = 0;
+    };
+
+
+    //=========================================================================
+    /**
+     * The process-wide state behind every TaskPool: the thread pool, and the
+     * tasks from all pools that are waiting for one of its threads. Obtained
+     * through a SharedResourcePointer, so it lives as long as any TaskPool.
+     */
+    class SharedExecutor
+    {
+    public:
+        SharedExecutor();
+        ~SharedExecutor();
+        void add (Pending task);
+        bool take (Job& job, Pending& task);
+        void removeRunning (const TaskPool* owner, const String& name);
+
+        ThreadPool threadPool;
+        CriticalSection lock;
+        std::vector<Pending> pending;
+        std::vector<std::pair<const TaskPool*, String>> running;
+    };
+
+
+    //=========================================================================
+    /**
+     * A thread pool job does not own a particular task. When it starts, it
+     * takes the most urgent pending task (or parallelFor item), and from
+     * then on carries that task's pool and name.
+     */
     class Job : public ThreadPoolJob
     {
     public:
-        Job (TaskPool& taskPool, const String& name, Task task);
+        Job (SharedExecutor& executor);
         JobStatus runJob() override;
-        TaskPool& taskPool;
-        Task task;
+        bool isRunningTaskOf (const TaskPool* taskPool, const String* name) const;
+        SharedExecutor& executor;
+        const TaskPool* owner = nullptr;
+        String taskName;
     };
 
 
@@ -91,18 +218,39 @@ private:
     class Selector : public ThreadPool::JobSelector
     {
     public:
-        Selector (const String& name);
+        Selector (const TaskPool* owner);
+        Selector (const TaskPool* owner, const String& name);
         bool isJobSuitable (ThreadPoolJob*) override;
+        const TaskPool* owner;
         String name;
+        bool anyName;
     };
 
 
     //=========================================================================
+    struct Notification
+    {
+        enum class Type { started, completed, cancelled, published };
+        Type type;
+        String name;
+        var result;
+        std::string error;
+    };
+
+
+    //=========================================================================
+    void handleAsyncUpdate() override;
+    void post (Notification notification);
     ThreadPoolJob::JobStatus notify (String name, var result, std::string error, bool completed);
     void indicateJobStarted (String name);
+    void publish (String name, var message);
+
+    static const uint32 agingIntervalMs = 1000;
 
-    ThreadPool threadPool;
+    SharedResourcePointer<SharedExecutor> executor;
     ListenerList<Listener> listeners;
+    CriticalSection notificationLock;
+    std::vector<Notification> notifications;
 };
 
 
@@ -0,0 +1,232 @@
+#include "TextTableCache.hpp"
+
+
+
+
+//=============================================================================
+static const int cacheFormatVersion = 1;
+
+static File getColumnFile (const File& directory, int index)
+{
+    return directory.getChildFile ("col-" + String (index) + ".f64");
+}
+
+
+
+
+//=============================================================================
+TextTableCache::TextTableCache()
+{
+    cacheDirectory = File::getSpecialLocation (File::userApplicationDataDirectory)
+    .getChildFile ("CounterPlot")
+    .getChildFile ("TextTableCache");
+    cacheDirectory.createDirectory();
+    currentSize = getDirectorySize (cacheDirectory);
+}
+
+bool TextTableCache::lookup (const File& source, TableInfo& info)
+{
+    const ScopedLock sl (lock);
+    auto directory = getEntryDirectory (source);
+
+    if (! isEntryValid (source, directory))
+    {
+        return false;
+    }
+
+    auto meta = directory.getChildFile ("table.json");
+    auto table = JSON::parse (meta);
+
+    info.names.clear();
+    info.numRows = (unsigned long) int64 (table["rows"]);
+
+    for (const auto& name : *table["names"].getArray())
+        info.names.push_back (name.toString().toStdString());
+
+    meta.setLastModificationTime (Time::getCurrentTime());
+    return true;
+}
+
+bool TextTableCache::readColumn (const File& source, int index, nd::array<double, 1>& data)
+{
+    return readColumnAs (source, index, data);
+}
+
+bool TextTableCache::readColumn (const File& source, int index, nd::array<float, 1>& data)
+{
+    return readColumnAs (source, index, data);
+}
+
+template<typename ValueType>
+bool TextTableCache::readColumnAs (const File& source, int index, nd::array<ValueType, 1>& data)
+{
+    const ScopedLock sl (lock);
+    auto directory = getEntryDirectory (source);
+    auto file = getColumnFile (directory, index);
+
+    if (! file.existsAsFile() || ! isEntryValid (source, directory))
+    {
+        return false;
+    }
+
+    auto numRows = int64 (JSON::parse (directory.getChildFile ("table.json"))["rows"]);
+    MemoryMappedFile mapped (file, MemoryMappedFile::readOnly);
+
+    if (mapped.getData() == nullptr || int64 (mapped.getSize()) != numRows * int64 (sizeof (double)))
+    {
+        return false;
+    }
+
+    auto values = static_cast<const double*> (mapped.getData());
+    data = nd::array<ValueType, 1> (int (numRows));
+    std::copy (values, values + numRows, data.begin());
+    return true;
+}
+
+void TextTableCache::writeTable (const File& source, const TableInfo& info)
+{
+    const ScopedLock sl (lock);
+    auto directory = getEntryDirectory (source);
+    auto names = Array<var>();
+    auto table = var (new DynamicObject);
+
+    for (const auto& name : info.names)
+        names.add (String (name));
+
+    table.getDynamicObject()->setProperty ("format", cacheFormatVersion);
+    table.getDynamicObject()->setProperty ("source", source.getFullPathName());
+    table.getDynamicObject()->setProperty ("size", source.getSize());
+    table.getDynamicObject()->setProperty ("modified", source.getLastModificationTime().toMilliseconds());
+    table.getDynamicObject()->setProperty ("rows", int64 (info.numRows));
+    table.getDynamicObject()->setProperty ("names", names);
+
+    if (directory.exists())
+    {
+        currentSize -= getDirectorySize (directory);
+        directory.deleteRecursively();
+    }
+    directory.createDirectory();
+
+    auto meta = directory.getChildFile ("table.json");
+    meta.replaceWithText (JSON::toString (table));
+    currentSize += meta.getSize();
+    evictUntilSizeIsAtMost (maximumSize, directory);
+}
+
+void TextTableCache::writeColumn (const File& source, int index, const nd::array<double, 1>& data)
+{
+    const ScopedLock sl (lock);
+    auto directory = getEntryDirectory (source);
+
+    if (! isEntryValid (source, directory))
+    {
+        return;
+    }
+
+    auto bytes = int64 (data.size() * sizeof (double));
+
+    if (bytes > maximumSize)
+    {
+        return;
+    }
+
+    auto file = getColumnFile (directory, index);
+    TemporaryFile temp (file);
+
+    if (auto stream = std::unique_ptr<FileOutputStream> (temp.getFile().createOutputStream()))
+    {
+        if (! stream->write (data.data(), size_t (bytes)))
+        {
+            return;
+        }
+    }
+    else
+    {
+        return;
+    }
+
+    currentSize -= file.getSize();
+
+    if (temp.overwriteTargetFileWithTemporary())
+    {
+        currentSize += bytes;
+    }
+    evictUntilSizeIsAtMost (maximumSize, directory);
+}
+
+void TextTableCache::setMaximumSize (int64 maximumSizeInBytes)
+{
+    const ScopedLock sl (lock);
+    maximumSize = maximumSizeInBytes;
+    evictUntilSizeIsAtMost (maximumSize, File());
+}
+
+void TextTableCache::clear()
+{
+    const ScopedLock sl (lock);
+    cacheDirectory.deleteRecursively();
+    cacheDirectory.createDirectory();
+    currentSize = 0;
+}
+
+
+
+
+//=============================================================================
+File TextTableCache::getEntryDirectory (const File& source) const
+{
+    return cacheDirectory.getChildFile (String::toHexString (source.getFullPathName().hashCode64()));
+}
+
+bool TextTableCache::isEntryValid (const File& source, const File& directory) const
+{
+    auto table = JSON::parse (directory.getChildFile ("table.json"));
+
+    return int (table["format"]) == cacheFormatVersion
+    && table["source"].toString() == source.getFullPathName()
+    && int64 (table["size"]) == source.getSize()
+    && int64 (table["modified"]) == source.getLastModificationTime().toMilliseconds()
+    && table["names"].isArray();
+}
+
+void TextTableCache::evictUntilSizeIsAtMost (int64 targetSize, const File& keep)
+{
+    if (currentSize <= targetSize)
+    {
+        return;
+    }
+
+
+    // Entries are evicted least recently used first; an entry's description
+    // is touched whenever the entry is looked up.
+    // ------------------------------------------------------------------------
+    auto entries = cacheDirectory.findChildFiles (File::findDirectories, false);
+
+    std::sort (entries.begin(), entries.end(), [] (const File& a, const File& b)
+    {
+        return a.getChildFile ("table.json").getLastModificationTime() < b.getChildFile ("table.json").getLastModificationTime();
+    });
+
+    for (const auto& entry : entries)
+    {
+        if (currentSize <= targetSize)
+        {
+            break;
+        }
+        if (entry != keep)
+        {
+            currentSize -= getDirectorySize (entry);
+            entry.deleteRecursively();
+        }
+    }
+}
+
+int64 TextTableCache::getDirectorySize (const File& directory)
+{
+    int64 size = 0;
+
+    for (const auto& file : directory.findChildFiles (File::findFiles, true))
+        size += file.getSize();
+
+    return size;
+}
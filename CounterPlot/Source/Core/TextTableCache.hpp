@@ -0,0 +1,102 @@
+#pragma once
+#include "JuceHeader.h"
+
+
+
+
+//=============================================================================
+/**
+ * A process-wide on-disk cache of parsed text tables. Each source file gets a
+ * directory in the user's application data directory. The directory holds a
+ * small description of the table (column names and number of rows), and one
+ * file of raw doubles for each column that has been decoded. Entries are only
+ * valid while the source file's size and modification time are unchanged.
+ *
+ * Columns are stored individually, so a column is only cached once something
+ * has asked for it. The total size of the cache is capped; when a write would
+ * exceed the cap, the least recently used tables are evicted.
+ *
+ * Obtain the cache through a SharedResourcePointer<TextTableCache>. The size
+ * of the cache directory is measured when the cache is created, so it should
+ * be held by something long-lived (Runtime::BuiltinCaches does this).
+ */
+class TextTableCache
+{
+public:
+
+
+    //=========================================================================
+    struct TableInfo
+    {
+        std::vector<std::string> names;
+        unsigned long numRows = 0;
+    };
+
+
+    //=========================================================================
+    TextTableCache();
+
+
+    /**
+     * Look up the table for the given source file. Return false if there is
+     * no valid entry for it.
+     */
+    bool lookup (const File& source, TableInfo& info);
+
+
+    /**
+     * Read a column of the given source file's table into data. Return false
+     * if the column has not been cached, or the entry is no longer valid.
+     */
+    bool readColumn (const File& source, int index, nd::array<double, 1>& data);
+
+
+    /**
+     * Read a column into single precision data, converting the cached values
+     * as they are read.
+     */
+    bool readColumn (const File& source, int index, nd::array<float, 1>& data);
+
+
+    /**
+     * Create (or replace) the entry for the given source file.
+     */
+    void writeTable (const File& source, const TableInfo& info);
+
+
+    /**
+     * Add a column to the entry for the given source file. This does nothing
+     * if there is no valid entry for that file.
+     */
+    void writeColumn (const File& source, int index, const nd::array<double, 1>& data);
+
+
+    /**
+     * Set the maximum total size of the cache on disk, evicting entries if
+     * needed.
+     */
+    void setMaximumSize (int64 maximumSizeInBytes);
+
+
+    /**
+     * Remove every entry from the cache.
+     */
+    void clear();
+
+
+private:
+
+
+    //=========================================================================
+    template<typename ValueType>
+    bool readColumnAs (const File& source, int index, nd::array<ValueType, 1>& data);
+    File getEntryDirectory (const File& source) const;
+    bool isEntryValid (const File& source, const File& directory) const;
+    void evictUntilSizeIsAtMost (int64 targetSize, const File& keep);
+    static int64 getDirectorySize (const File& directory);
+
+    CriticalSection lock;
+    File cacheDirectory;
+    int64 maximumSize = int64 (1) << 30;
+    int64 currentSize = 0;
+};
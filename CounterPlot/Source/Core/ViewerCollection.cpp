@@ -9,7 +9,11 @@
 //=============================================================================
 ViewerCollection::ViewerCollection()
 {
-    startTimer (330);
+}
+
+ViewerCollection::~ViewerCollection()
+{
+    fileNotifications->unsubscribeAll (this);
 }
 
 void ViewerCollection::addListener (Listener* listener)
@@ -35,6 +39,7 @@ void ViewerCollection::clear()
 
     items.clear();
     extensionDirectories.clear();
+    fileNotifications->unsubscribeAll (this);
 }
 
 Array<File> ViewerCollection::getWatchedDirectories() const
@@ -109,6 +114,7 @@ void ViewerCollection::startWatchingDirectory (File directory)
     if (! watchesDirectory (directory))
     {
         extensionDirectories.add ({directory, Time::getCurrentTime()});
+        fileNotifications->subscribe (this, directory);
         loadAllInDirectory (directory);
     }
 }
@@ -123,6 +129,7 @@ void ViewerCollection::stopWatchingDirectory (File directory)
         {
             if (ext.directory == directory)
             {
+                fileNotifications->unsubscribe (this, directory);
                 unloadAllInDirectory (directory);
                 break;
             }
@@ -205,6 +212,7 @@ void ViewerCollection::loadAllInDirectory (File directory)
             auto v = viewer.get();
             viewer->configure (child);
             items.add ({ true, child, Time::getCurrentTime(), std::move (viewer) });
+            fileNotifications->subscribe (this, child);
             listeners.call (&Listener::viewerCollectionViewerAdded, v);
             listeners.call (&Listener::viewerCollectionViewerReconfigured, v);
         }
@@ -219,8 +227,13 @@ void ViewerCollection::unloadAllInDirectory (File directory)
     };
 
     for (const auto& item : items)
+    {
         if (predicate (item))
+        {
+            fileNotifications->unsubscribe (this, item.source);
             listeners.call (&Listener::viewerCollectionViewerRemoved, item.viewer.get());
+        }
+    }
 
     items.removeIf (predicate);
 }
@@ -233,8 +246,13 @@ void ViewerCollection::unloadAllNonexistentInDirectory (File directory)
     };
 
     for (const auto& item : items)
+    {
         if (predicate (item))
+        {
+            fileNotifications->unsubscribe (this, item.source);
             listeners.call (&Listener::viewerCollectionViewerRemoved, item.viewer.get());
+        }
+    }
 
     items.removeIf (predicate);
 }
@@ -243,11 +261,14 @@ void ViewerCollection::unloadAllNonexistentInDirectory (File directory)
 
 
 //=========================================================================
-void ViewerCollection::timerCallback()
+void ViewerCollection::fileNotificationServiceFilesChanged (const Array<File>& changedFiles)
 {
+    // Each extension file is subscribed to on its own, since not every
+    // platform reports writes to the children of a watched directory; the
+    // directory may also be reported as a whole when its entries change.
     for (auto& item : items)
     {
-        if (item.isExtension && item.lastLoaded < item.source.getLastModificationTime())
+        if (item.isExtension && changedFiles.contains (item.source) && item.source.existsAsFile())
         {
             auto& viewer = dynamic_cast<UserExtensionView&> (*item.viewer);
             viewer.configure (item.source);
@@ -258,10 +279,15 @@ void ViewerCollection::timerCallback()
 
     for (auto& ext : extensionDirectories)
     {
-        if (ext.lastLoaded < ext.directory.getLastModificationTime())
+        for (const auto& file : changedFiles)
         {
-            loadAllInDirectory (ext.directory);
-            unloadAllNonexistentInDirectory (ext.directory);
+            if (file == ext.directory || file.getParentDirectory() == ext.directory)
+            {
+                loadAllInDirectory (ext.directory);
+                unloadAllNonexistentInDirectory (ext.directory);
+                ext.lastLoaded = Time::getCurrentTime();
+                break;
+            }
         }
     }
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include "JuceHeader.h"
 #include "../Viewers/Viewer.hpp"
+#include "FileNotificationService.hpp"
 
 
 
@@ -12,7 +13,7 @@ class UserExtensionView;
 
 
 //=============================================================================
-class ViewerCollection : public Timer
+class ViewerCollection : private FileNotificationService::Listener
 {
 public:
 
@@ -36,6 +37,12 @@ public:
     ViewerCollection();
 
 
+    /**
+     * Destructor.
+     */
+    ~ViewerCollection();
+
+
     /**
      * Add a listener. Listeners are notified whenever new extension views are
      * added and removed, or when their source code changes and their configure
@@ -108,7 +115,8 @@ public:
     /**
      * Load all the extensions in the given directory, and keep them in sync.
      * Removing a file from that directory will trigger the extension to be
-     * unloaded, and if a new one is added, it will be loaded.
+     * unloaded, and if a new one is added, it will be loaded. Changes are
+     * picked up from the file notification service.
      */
     void startWatchingDirectory (File directory);
 
@@ -171,7 +179,7 @@ private:
     void unloadAllNonexistentInDirectory (File directory);
 
     //=========================================================================
-    void timerCallback() override;
+    void fileNotificationServiceFilesChanged (const Array<File>& changedFiles) override;
 
     //=========================================================================
     struct Item
@@ -192,4 +200,5 @@ private:
     Array<ExtensionDirectory> extensionDirectories;
     Rectangle<int> bounds;
     ListenerList<Listener> listeners;
+    SharedResourcePointer<FileNotificationService> fileNotifications;
 };
@@ -284,17 +284,18 @@ std::vector<simd::float2> MeshHelpers::triangulateUniformRectilinearMesh (int ni
     return verts;
 }
 
-std::vector<simd::float2> MeshHelpers::triangulateQuadMesh (const nd::array<double, 3>& vertices, Bailout bailout)
+template<typename ValueType>
+static std::vector<simd::float2> triangulateQuadMeshRows (const nd::array<ValueType, 3>& vertices,
+                                                          MeshHelpers::Bailout bailout,
+                                                          MeshHelpers::ParallelFor parallelFor)
 {
     int ni = vertices.shape(0) - 1;
     int nj = vertices.shape(1) - 1;
-    std::vector<simd::float2> verts;
-    verts.reserve (ni * nj * 6);
+    std::vector<simd::float2> verts (ni * nj * 6);
 
-    for (int i = 0; i < ni; ++i)
+    auto triangulateRow = [&] (int i)
     {
-        if (bailout && bailout())
-            break;
+        auto v = verts.data() + i * nj * 6;
 
         for (int j = 0; j < nj; ++j)
         {
@@ -307,17 +308,42 @@ std::vector<simd::float2> MeshHelpers::triangulateQuadMesh (const nd::array<doub
             const float y10 = vertices (i + 1, j + 0, 1);
             const float y11 = vertices (i + 1, j + 1, 1);
 
-            verts.push_back (simd::float2 {x00, y00});
-            verts.push_back (simd::float2 {x01, y01});
-            verts.push_back (simd::float2 {x10, y10});
-            verts.push_back (simd::float2 {x01, y01});
-            verts.push_back (simd::float2 {x10, y10});
-            verts.push_back (simd::float2 {x11, y11});
+            *v++ = simd::float2 {x00, y00};
+            *v++ = simd::float2 {x01, y01};
+            *v++ = simd::float2 {x10, y10};
+            *v++ = simd::float2 {x01, y01};
+            *v++ = simd::float2 {x10, y10};
+            *v++ = simd::float2 {x11, y11};
+        }
+    };
+
+    if (parallelFor)
+    {
+        parallelFor (ni, triangulateRow);
+    }
+    else
+    {
+        for (int i = 0; i < ni; ++i)
+        {
+            if (bailout && bailout())
+                break;
+
+            triangulateRow (i);
         }
     }
     return verts;
 }
 
+std::vector<simd::float2> MeshHelpers::triangulateQuadMesh (const nd::array<double, 3>& vertices, Bailout bailout, ParallelFor parallelFor)
+{
+    return triangulateQuadMeshRows (vertices, bailout, parallelFor);
+}
+
+std::vector<simd::float2> MeshHelpers::triangulateQuadMesh (const nd::array<float, 3>& vertices, Bailout bailout, ParallelFor parallelFor)
+{
+    return triangulateQuadMeshRows (vertices, bailout, parallelFor);
+}
+
 std::vector<simd::float1> MeshHelpers::makeRectilinearGridScalars (const nd::array<double, 2>& scalar, Bailout bailout)
 {
     if (bailout != nullptr && bailout())
@@ -316,6 +316,7 @@ class MeshHelpers
 {
 public:
     using Bailout = std::function<bool()>;
+    using ParallelFor = std::function<void(int, std::function<void(int)>)>;
 
     /**
      * Return a list of 2D triangle vertices that cover a uniform rectilinear
@@ -330,9 +331,13 @@ public:
     /**
      * Return triangle data of the same format as above, except using a 3D array
      * of vertex data [ni, nj, 2]. The final axis contains the (x, y) position of
-     * the (i, j) vertex.
+     * the (i, j) vertex. If a parallelFor function is given, the rows of the
+     * mesh are handed to it as independent items, and it is responsible for
+     * bailing out; otherwise the rows are triangulated serially. Float vertex
+     * data is accepted too, and goes into the result without being widened.
      */
-    static std::vector<simd::float2> triangulateQuadMesh (const nd::array<double, 3>& vertices, Bailout=nullptr);
+    static std::vector<simd::float2> triangulateQuadMesh (const nd::array<double, 3>& vertices, Bailout=nullptr, ParallelFor=nullptr);
+    static std::vector<simd::float2> triangulateQuadMesh (const nd::array<float, 3>& vertices, Bailout=nullptr, ParallelFor=nullptr);
 
     /**
      * Return a list of scalars corresponding to the triangulation of a quadrilateral
@@ -108,7 +108,7 @@ static std::unique_ptr<KernelAgent> agentFactory (const var& value)
 
 
 //=============================================================================
-UserExtensionView::UserExtensionView() : taskPool (4)
+UserExtensionView::UserExtensionView()
 {
     reset();
     taskPool.addListener (this);
@@ -118,6 +118,10 @@ UserExtensionView::UserExtensionView() : taskPool (4)
 void UserExtensionView::reset()
 {
     kernel.clear();
+    snapshots.clear();
+    snapshotBytesCopied.clear();
+    pipelines.clear();
+    pipelineOwners.clear();
     Runtime::load_builtins (kernel);
     kernel.insert ("file", currentFile.getFullPathName());
     kernel.insert ("stops", Runtime::make_data (colourMaps.getCurrentStops()));
@@ -132,6 +136,9 @@ void UserExtensionView::configure (const var& config)
 {
     // Reset everything but the kernel
     // -----------------------------------------------------------------------
+    while (! pipelines.empty())
+        abandonPipeline (pipelines.begin()->first);
+
     taskPool.cancelAll();
     figures.clear();
     controls.clear();
@@ -175,6 +182,11 @@ void UserExtensionView::configure (const var& config)
     asyncRules = DataHelpers::stringArrayFromVar (config["expensive"]);
 
 
+    // Bound the memory used to cache results of expensive rules (megabytes).
+    // -----------------------------------------------------------------------
+    resultCache.setMaximumSize (std::size_t (int (config.getProperty ("cache-size", 256))) * 1024 * 1024);
+
+
     // Load commands
     // -----------------------------------------------------------------------
     extensionCommands = config["commands"];
@@ -259,17 +271,49 @@ void UserExtensionView::resized()
     applyLayout();
 }
 
+void UserExtensionView::visibilityChanged()
+{
+    for (const auto& item : pipelines)
+        taskPool.setPriority (item.first, getTaskPriority (item.first));
+}
+
 void UserExtensionView::applyLayout()
 {
     layout.performLayout (getLocalBounds());
 
     int n = 0;
+    bool pixelsChanged = false;
 
     for (auto item : layout.items)
     {
         figures[n]->setBoundsAndSendDomainResizeIfNeeded (item.currentBounds.toNearestIntEdges());
+        pixelsChanged |= capturePlotAreaSize (figures[n]);
         ++n;
     }
+
+    if (pixelsChanged)
+        resolveKernel();
+}
+
+bool UserExtensionView::capturePlotAreaSize (FigureView* figure)
+{
+    // The plot area size is captured only when it changes, so that rules
+    // depending on it (e.g. level-of-detail windows) aren't re-run needlessly.
+    // ------------------------------------------------------------------------
+    const auto& capture = figure->getModel().capture;
+
+    if (! capture.count ("pixels"))
+        return false;
+
+    auto area = figure->getPlotAreaBounds();
+    auto pixels = var (Array<var> { area.getWidth(), area.getHeight() });
+    const auto& key = capture.at ("pixels");
+
+    if (kernel.contains (key) && kernel.at (key) == pixels)
+        return false;
+
+    kernel.insert (key, pixels);
+    return true;
 }
 
 
@@ -310,6 +354,21 @@ const Runtime::Kernel* UserExtensionView::getKernel() const
     return &kernel;
 }
 
+StringPairArray UserExtensionView::getStatistics() const
+{
+    auto result = StringPairArray();
+
+    for (const auto& item : snapshotBytesCopied)
+        result.set ("snapshot " + String (item.first) + " (est.)", File::descriptionOfSizeInBytes (int64 (item.second)));
+
+    result.addArray (resultCache.getStatistics());
+    result.set ("queued high",   String (taskPool.getNumTasksQueued (TaskPool::high)));
+    result.set ("queued normal", String (taskPool.getNumTasksQueued (TaskPool::normal)));
+    result.set ("queued low",    String (taskPool.getNumTasksQueued (TaskPool::low)));
+    result.set ("tasks joined",  String (numJoinedPipelines));
+    return result;
+}
+
 bool UserExtensionView::canReceiveMessages() const
 {
     return true;
@@ -333,7 +392,7 @@ bool UserExtensionView::receiveMessage (const String& message)
 
 bool UserExtensionView::isRenderingComplete() const
 {
-    return taskPool.getNumJobsRunningOrQueued() == 0 && kernel.dirty_rules().empty();
+    return taskPool.getNumJobsRunningOrQueued() == 0 && kernel.dirty_rules().empty() && pipelines.empty();
 }
 
 Image UserExtensionView::createViewerSnapshot()
@@ -385,6 +444,7 @@ void UserExtensionView::figureViewSetDomain (FigureView* figure, const Rectangle
     if (capture.count ("xmax")) kernel.insert (capture.at ("xmax"), var (x1));
     if (capture.count ("ymin")) kernel.insert (capture.at ("ymin"), var (y0));
     if (capture.count ("ymax")) kernel.insert (capture.at ("ymax"), var (y1));
+    capturePlotAreaSize (figure);
     resolveKernel();
 }
 
@@ -476,12 +536,16 @@ void UserExtensionView::taskStarted (const String& taskName)
 
 void UserExtensionView::taskCompleted (const String& taskName, const var& result, const std::string& error)
 {
-    auto key = taskName.toStdString();
-    kernel.update_directly (key, result, error);
-    kernel.mark (kernel.downstream (key));
-    loadFromKernelIfFigure (key);
-    loadFromKernelIfControl (key);
-    resolveKernel();
+    auto head = taskName.toStdString();
+
+    // Every asynchronous task is a pipeline, whose results have already been
+    // published; the task's own result is the pipeline id. Stages the pipeline
+    // did not reach (e.g. after an error) are released back to the kernel.
+    // ------------------------------------------------------------------------
+    if (pipelines.count (head) && pipelines.at (head).id == int (result))
+        abandonPipeline (head);
+
+    resolveAfterTaskBatch = true;
     sendAsyncTaskCompleted (taskName);
 }
 
@@ -490,6 +554,76 @@ void UserExtensionView::taskCancelled (const String& taskName)
     sendAsyncTaskCancelled (taskName);
 }
 
+void UserExtensionView::taskPublished (const String& taskName, const var& message)
+{
+    auto head  = taskName.toStdString();
+    auto key   = message["rule"].toString().toStdString();
+    auto error = message["error"].toString().toStdString();
+    auto value = message["value"];
+
+
+    // Messages from a pipeline that has since been replaced or abandoned are
+    // stale, as are stages that were re-dirtied from outside the pipeline.
+    // ------------------------------------------------------------------------
+    if (! pipelines.count (head) || pipelines.at (head).id != int (message["pipeline"]))
+        return;
+
+    if (key != head)
+    {
+        if (! pipelineOwners.count (key) || pipelineOwners.at (key) != head)
+            return;
+
+        pipelineOwners.erase (key);
+    }
+
+
+    // The head's cache key was made when the pipeline was enqueued. A stage's
+    // upstream values are now exactly those the pipeline used, since the stages
+    // before it were published in order, and anything else it depends on would
+    // have re-dirtied it.
+    // ------------------------------------------------------------------------
+    if (error.empty())
+    {
+        if (key != head)
+        {
+            resultCache.insert (resultCache.makeKey (kernel, key), value);
+        }
+        else if (pendingCacheKeys.count (head))
+        {
+            // A key made before the files it names were stamped is not
+            // cacheable, but they usually have been by now.
+            // ----------------------------------------------------------------
+            auto cacheKey = pendingCacheKeys.at (head);
+
+            if (! cacheKey.cacheable)
+                cacheKey = resultCache.makeKey (kernel, head);
+
+            resultCache.insert (cacheKey, value);
+        }
+    }
+
+    if (key == head)
+        pendingCacheKeys.erase (head);
+
+    kernel.update_directly (key, value, error);
+    markDownstream (key);
+    loadFromKernelIfFigure (key);
+    loadFromKernelIfControl (key);
+    resolveAfterTaskBatch = true;
+}
+
+void UserExtensionView::taskBatchDelivered()
+{
+    // Any number of tasks may have completed or published in this batch; the
+    // kernel is resolved (and the environment view refreshed) just once.
+    // ------------------------------------------------------------------------
+    if (resolveAfterTaskBatch)
+    {
+        resolveAfterTaskBatch = false;
+        resolveKernel();
+    }
+}
+
 
 
 
@@ -497,36 +631,39 @@ void UserExtensionView::taskCancelled (const String& taskName)
 void UserExtensionView::resolveKernel (bool startAsyncTasks)
 {
 
-    // Try to update all the rules that are dirty and not asynchronous.
-    // We don't use kernel::update_all here, because that recurses and
-    // can hit rules that become eligible, but are asynchronous. Not all
-    // of the rules will be updated, since some will have asynchronous
-    // depenencies. Below we record the number of rules that were updated
-    // in each pass, and break if none had become eligible.
+    // Update the rules that are dirty and not asynchronous. These are
+    // ordered once into levels, where each rule depends only on rules
+    // in earlier levels (or on clean rules). The rules in a level are
+    // resolved concurrently against one kernel snapshot, and the
+    // results are then applied to the kernel, figures, and controls on
+    // this thread, in level order. Rules with dirty asynchronous
+    // upstream rules are not scheduled, and so stay dirty; no other
+    // synchronous rule should be left eligible.
     // --------------------------------------------------------------
-    auto synchronousDirtyRules = kernel.dirty_rules_excluding (Runtime::asynchronous);
-
-    while (! synchronousDirtyRules.empty())
+    for (const auto& level : scheduleSynchronousRules())
     {
-        int numUpdatedRules = 0;
+        auto snapshot = snapshots.take (kernel, level);
+        auto results = std::vector<var> (level.size());
+        auto errors = std::vector<std::string> (level.size());
 
-        for (const auto& rule : synchronousDirtyRules)
+        taskPool.parallelFor (int (level.size()), [&] (int n)
         {
-            if (kernel.eligible (rule)) // && ! taskPool.areAnyRunning (kernel.upstream (rule))
-            {
-                kernel.update (rule);
-                loadFromKernelIfFigure (rule);
-                loadFromKernelIfControl (rule);
-                ++numUpdatedRules;
-            }
-        }
-        if (numUpdatedRules == 0)
+            results[n] = snapshot.resolve (level[n], errors[n], VarCallAdapter());
+        });
+
+        for (std::size_t n = 0; n < level.size(); ++n)
         {
-            break;
+            kernel.update_directly (level[n], results[n], errors[n]);
+            loadFromKernelIfFigure (level[n]);
+            loadFromKernelIfControl (level[n]);
         }
-        synchronousDirtyRules = kernel.dirty_rules_excluding (Runtime::asynchronous);
     }
 
+#if JUCE_DEBUG
+    for (const auto& rule : kernel.dirty_rules_excluding (Runtime::asynchronous))
+        jassert (! kernel.eligible (rule));
+#endif
+
     sendEnvironmentChanged();
 
     if (! startAsyncTasks)
@@ -538,32 +675,343 @@ void UserExtensionView::resolveKernel (bool startAsyncTasks)
     // rules will not become eligible until after the task is finished.
     // Each rule that is eligible for update gets enqueued, which
     // cancels any earlier tasks with the same name. Rules that are
-    // asynchronous and dirty, but not eligible, are canceled.
+    // asynchronous and dirty, but not eligible, are canceled. Eligible
+    // rules whose result is in the cache are updated immediately; if
+    // any were, the kernel is resolved again, since rules downstream
+    // of them may have become eligible.
+    //
+    // An enqueued rule heads a pipeline: the dirty asynchronous rules
+    // downstream of it that depend on nothing else dirty are resolved
+    // by the same task, each stage handing its value to the next
+    // without a round trip through this thread.
     // --------------------------------------------------------------
+    joinIdenticalPipelines();
+
+    int numCacheHits = 0;
+    auto claimed = std::set<std::string>();
+
     for (auto rule : kernel.dirty_rules_only (Runtime::asynchronous))
     {
+        if (claimed.count (rule))
+        {
+            continue;
+        }
+
+        // A stage that is dirty again was changed from outside of its
+        // pipeline, so the value the pipeline would publish is stale.
+        // --------------------------------------------------------------
+        pipelineOwners.erase (rule);
+
         if (kernel.eligible (rule))
         {
-            kernel.unmark (rule);
+            abandonPipeline (rule);
+
+            auto cacheKey = resultCache.makeKey (kernel, rule);
+            auto cached = var();
+
+            if (resultCache.lookup (cacheKey, cached))
+            {
+                taskPool.cancel (rule);
+                kernel.update_directly (rule, cached, std::string());
+                markDownstream (rule);
+                loadFromKernelIfFigure (rule);
+                loadFromKernelIfControl (rule);
+                ++numCacheHits;
+                continue;
+            }
+
+            auto pipeline = Pipeline();
+            pipeline.id = ++nextPipelineId;
+            pipeline.stages = findPipelineStages (rule);
+
+            auto rules = pipeline.stages;
+            rules.insert (rules.begin(), rule);
+
+            auto snapshot = snapshots.take (kernel, rules);
+            snapshotBytesCopied[rule] = snapshot.getNumBytesCopied();
+
+            for (const auto& key : rules)
+                kernel.unmark (key);
+
+            for (const auto& stage : pipeline.stages)
+            {
+                pipelineOwners[stage] = rule;
+                claimed.insert (stage);
+            }
+
+            for (const auto& key : rules)
+                pipeline.fingerprints[key] = fingerprintPipelineRule (pipeline, rule, key);
 
-            taskPool.enqueue (rule, [kernel=kernel, rule] (auto bailout)
+            pendingCacheKeys[rule] = cacheKey;
+            pipelines[rule] = pipeline;
+
+            auto priority = getTaskPriority (rule);
+
+            taskPool.enqueuePipeline (rule, [snapshot, rules, id = pipeline.id, executor = taskPool.getExecutor()] (auto bailout, auto publish)
             {
-                auto what = std::string();
-                auto adapter = VarCallAdapter (bailout);
-                auto result = kernel.resolve (rule, what, adapter);
+                auto adapter = VarCallAdapter (bailout, executor);
+                auto scope = snapshot;
 
-                if (what.empty())
+                for (const auto& key : rules)
                 {
-                    return result;
+                    auto what = std::string();
+                    auto result = scope.resolve (key, what, adapter);
+
+                    // Lazily loaded data (e.g. load-text columns) is decoded
+                    // here, so that no rule reading it later does the work.
+                    // ----------------------------------------------------------
+                    if (what.empty() && ! bailout())
+                    {
+                        try {
+                            Runtime::force_data (result);
+                        }
+                        catch (const std::exception& e) {
+                            what = e.what();
+                        }
+                    }
+
+                    if (bailout())
+                    {
+                        break;
+                    }
+
+                    auto message = var (new DynamicObject);
+                    message.getDynamicObject()->setProperty ("pipeline", id);
+                    message.getDynamicObject()->setProperty ("rule", String (key));
+                    message.getDynamicObject()->setProperty ("value", result);
+                    message.getDynamicObject()->setProperty ("error", String (what));
+                    publish (message);
+
+                    if (! what.empty())
+                    {
+                        break;
+                    }
+                    scope = scope.withValue (key, result);
                 }
-                throw std::runtime_error (what);
-            });
+                return var (id);
+            }, priority);
         }
         else
         {
             taskPool.cancel (rule);
+            abandonPipeline (rule);
+        }
+    }
+
+    if (numCacheHits > 0)
+    {
+        resolveKernel();
+    }
+}
+
+std::vector<std::vector<std::string>> UserExtensionView::scheduleSynchronousRules() const
+{
+    auto dirtyRules = kernel.dirty_rules();
+    auto dirty = std::set<std::string> (dirtyRules.begin(), dirtyRules.end());
+    auto depth = std::map<std::string, int>();
+    auto levels = std::vector<std::vector<std::string>>();
+
+
+    // The depth of a dirty rule is one more than the deepest of its dirty
+    // upstream rules, or -1 if it can't be updated synchronously: it either
+    // has a dirty asynchronous upstream rule, or is part of a cycle. A
+    // depth of -2 marks a rule whose depth is being computed.
+    // ------------------------------------------------------------------------
+    std::function<int(const std::string&)> computeDepth = [&] (const std::string& rule) -> int
+    {
+        if (depth.count (rule))
+            return depth[rule] == -2 ? -1 : depth[rule];
+
+        if (kernel.flags_at (rule) & Runtime::asynchronous)
+            return depth[rule] = -1;
+
+        depth[rule] = -2;
+        int result = 0;
+
+        for (const auto& key : kernel.upstream (rule))
+        {
+            if (dirty.count (key) && kernel.contains (key))
+            {
+                auto d = computeDepth (key);
+
+                if (d == -1)
+                {
+                    result = -1;
+                    break;
+                }
+                result = jmax (result, d + 1);
+            }
+        }
+        return depth[rule] = result;
+    };
+
+    for (const auto& rule : kernel.dirty_rules_excluding (Runtime::asynchronous))
+    {
+        auto d = computeDepth (rule);
+
+        if (d >= 0)
+        {
+            if (int (levels.size()) <= d)
+                levels.resize (d + 1);
+
+            levels[d].push_back (rule);
+        }
+    }
+    return levels;
+}
+
+std::vector<std::string> UserExtensionView::findPipelineStages (const std::string& head) const
+{
+    auto dirtyRules = kernel.dirty_rules();
+    auto dirty = std::set<std::string> (dirtyRules.begin(), dirtyRules.end());
+    auto members = std::set<std::string> { head };
+    auto candidates = std::set<std::string>();
+    auto stages = std::vector<std::string>();
+
+    auto addCandidatesDownstreamOf = [&] (const std::string& rule)
+    {
+        for (const auto& key : kernel.downstream (rule))
+            if (dirty.count (key) && ! members.count (key) && ! pipelineOwners.count (key)
+                && (kernel.flags_at (key) & Runtime::asynchronous))
+                candidates.insert (key);
+    };
+
+
+    // A candidate joins the pipeline once all of its dirty upstream rules are
+    // members, so stages come out in dependency order. Rules owned by another
+    // in-flight pipeline count as dirty here, since their values are pending.
+    // ------------------------------------------------------------------------
+    addCandidatesDownstreamOf (head);
+
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+
+        for (const auto& rule : candidates)
+        {
+            if (members.count (rule))
+                continue;
+
+            auto ready = true;
+
+            for (const auto& key : kernel.upstream (rule))
+                if (! members.count (key) && (dirty.count (key) || pipelineOwners.count (key)))
+                    ready = false;
+
+            if (ready)
+            {
+                members.insert (rule);
+                stages.push_back (rule);
+                changed = true;
+            }
+        }
+
+        for (const auto& rule : stages)
+            addCandidatesDownstreamOf (rule);
+    }
+    return stages;
+}
+
+void UserExtensionView::abandonPipeline (const std::string& head)
+{
+    if (! pipelines.count (head))
+    {
+        return;
+    }
+
+    auto released = decltype (kernel.downstream (head))();
+
+    for (const auto& stage : pipelines.at (head).stages)
+    {
+        if (pipelineOwners.count (stage) && pipelineOwners.at (stage) == head)
+        {
+            pipelineOwners.erase (stage);
+            released.insert (stage);
         }
     }
+    kernel.mark (released);
+    pipelines.erase (head);
+    pendingCacheKeys.erase (head);
+}
+
+void UserExtensionView::joinIdenticalPipelines()
+{
+    auto dirtyRules = kernel.dirty_rules();
+    auto dirty = std::set<std::string> (dirtyRules.begin(), dirtyRules.end());
+
+
+    // A dirty head whose in-flight pipeline was started from the same
+    // expression and inputs (e.g. a capture re-inserted an unchanged value,
+    // or the same file was loaded again) is attached to that pipeline rather
+    // than restarting it. Its stages are attached individually, so a stage
+    // with a genuinely changed input is still released and recomputed.
+    // ------------------------------------------------------------------------
+    for (const auto& item : pipelines)
+    {
+        const auto& head = item.first;
+        const auto& pipeline = item.second;
+
+        if (! dirty.count (head)
+            || ! kernel.eligible (head)
+            || ! taskPool.isRunningOrQueued (head)
+            || fingerprintPipelineRule (pipeline, head, head) != pipeline.fingerprints.at (head))
+            continue;
+
+        kernel.unmark (head);
+        ++numJoinedPipelines;
+
+        for (const auto& stage : pipeline.stages)
+            if (dirty.count (stage)
+                && pipelineOwners.count (stage)
+                && pipelineOwners.at (stage) == head
+                && fingerprintPipelineRule (pipeline, head, stage) == pipeline.fingerprints.at (stage))
+                kernel.unmark (stage);
+    }
+}
+
+std::string UserExtensionView::fingerprintPipelineRule (const Pipeline& pipeline, const std::string& head, const std::string& rule) const
+{
+    auto members = std::set<std::string> (pipeline.stages.begin(), pipeline.stages.end());
+    members.insert (head);
+    return resultCache.makeKey (kernel, rule, members).text;
+}
+
+void UserExtensionView::markDownstream (const std::string& rule)
+{
+    auto downstream = kernel.downstream (rule);
+
+
+    // Rules still owned by a pipeline, and the rules downstream of them, will
+    // be marked when those stages are published.
+    // ------------------------------------------------------------------------
+    for (const auto& item : pipelineOwners)
+    {
+        downstream.erase (item.first);
+
+        for (const auto& key : kernel.downstream (item.first))
+            downstream.erase (key);
+    }
+    kernel.mark (downstream);
+}
+
+TaskPool::Priority UserExtensionView::getTaskPriority (const std::string& rule) const
+{
+    auto feeds = kernel.downstream (rule);
+    auto result = TaskPool::low;
+
+    feeds.insert (rule);
+
+    for (const auto& key : feeds)
+    {
+        if (auto figure = findChildWithID (key))
+            if (figure->isShowing())
+                return TaskPool::high;
+
+        for (auto control : controls)
+            if (control->getAgentID() == key)
+                result = TaskPool::normal;
+    }
+    return result;
 }
 
 void UserExtensionView::loadFromKernelIfFigure (const std::string& id)
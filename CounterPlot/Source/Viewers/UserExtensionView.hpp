@@ -4,6 +4,7 @@
 #include "../Core/Runtime.hpp"
 #include "../Core/ConfigurableFileFilter.hpp"
 #include "../Core/TaskPool.hpp"
+#include "../Core/ResultCache.hpp"
 
 
 
@@ -110,6 +111,7 @@ public:
 
     //=========================================================================
     void resized() override;
+    void visibilityChanged() override;
 
     //=========================================================================
     bool isInterestedInFile (File file) const override;
@@ -117,6 +119,7 @@ public:
     void reloadFile() override;
     String getViewerName() const override;
     const Runtime::Kernel* getKernel() const override;
+    StringPairArray getStatistics() const override;
     bool canReceiveMessages() const override;
     bool receiveMessage (const String& message) override;
     bool isRenderingComplete() const override;
@@ -145,12 +148,36 @@ public:
     void taskStarted (const String& taskName) override;
     void taskCompleted (const String& taskName, const var& result, const std::string& error) override;
     void taskCancelled (const String& taskName) override;
+    void taskPublished (const String& taskName, const var& message) override;
+    void taskBatchDelivered() override;
 
 private:
 
+    //=========================================================================
+    /**
+     * A chain of asynchronous rules resolved by a single worker task. The head
+     * rule names the task; the stages are the dirty asynchronous rules whose
+     * dirty upstream rules all belong to the pipeline, in dependency order.
+     * Each result is published to the message thread as soon as it lands.
+     */
+    struct Pipeline
+    {
+        int id = 0;
+        std::vector<std::string> stages;
+        std::map<std::string, std::string> fingerprints;
+    };
+
     //=========================================================================
     void applyLayout();
+    bool capturePlotAreaSize (FigureView* figure);
     void resolveKernel (bool startAsyncTasks=true);
+    std::vector<std::vector<std::string>> scheduleSynchronousRules() const;
+    std::vector<std::string> findPipelineStages (const std::string& head) const;
+    void abandonPipeline (const std::string& head);
+    void joinIdenticalPipelines();
+    std::string fingerprintPipelineRule (const Pipeline& pipeline, const std::string& head, const std::string& rule) const;
+    void markDownstream (const std::string& rule);
+    TaskPool::Priority getTaskPriority (const std::string& rule) const;
     void loadFromKernelIfFigure (const std::string& id);
     void loadFromKernelIfControl (const std::string& id);
     void loadExpressionsFromDictIntoKernel (Runtime::Kernel& kernel, const var& dict, bool rethrowExceptions=false) const;
@@ -161,11 +188,21 @@ private:
     Grid layout;
     ColourMapCollection colourMaps;
     ConfigurableFileFilter fileFilter;
+    Runtime::BuiltinCaches builtinCaches;
     Runtime::Kernel kernel;
+    Runtime::SnapshotCache snapshots;
+    std::map<std::string, std::size_t> snapshotBytesCopied;
     OwnedArray<FigureView> figures;
     OwnedArray<KernelAgent> controls;
     File currentFile;
     TaskPool taskPool;
+    ResultCache resultCache;
+    std::map<std::string, ResultCache::Key> pendingCacheKeys;
+    std::map<std::string, Pipeline> pipelines;
+    std::map<std::string, std::string> pipelineOwners;
+    int nextPipelineId = 0;
+    int numJoinedPipelines = 0;
+    bool resolveAfterTaskBatch = false;
     StringArray asyncRules;
     var extensionCommands;
 };
@@ -1,8 +1,6 @@
-#include <fstream>
 #include "Viewer.hpp"
 #include "../Components/VariantTree.hpp"
 #include "../Core/DataHelpers.hpp"
-#include "../Core/AsciiLoader.hpp"
 #include "yaml-cpp/yaml.h"
 
 
@@ -169,28 +167,33 @@ void AsciiTableViewer::loadFile (File file)
     if (currentFile != file)
     {
         currentFile = file;
+        loader = nullptr;
         reloadFile();
     }
 }
 
 void AsciiTableViewer::reloadFile()
 {
-    auto stream = std::ifstream (currentFile.getFullPathName().toStdString());
-    auto loader = AsciiLoader (stream);
+    // Logs that are only being appended to are extended with their new rows,
+    // rather than read again.
+    if (loader == nullptr || ! loader->appendNewRows (currentFile))
+    {
+        loader = std::make_unique<AsciiLoader> (currentFile);
+        loader->loadAllColumns();
+    }
 
-    if (! loader.getStatusMessage().empty())
+    if (! loader->getStatusMessage().empty())
     {
+        loader = nullptr;
         return;
     }
 
     model.columns.clear();
 
-    for (int n = 0; n < loader.getNumColumns(); ++n)
+    for (int n = 0; n < loader->getNumColumns(); ++n)
     {
-        auto name = loader.getColumnName(n);
-        auto data = nd::array<double, 1> (int (loader.getNumRows()));
-        loader.column (n, data.begin());
-        model.columns.add ({name, data});
+        auto name = loader->getColumnName(n);
+        model.columns.add ({name, loader->getColumn (n)});
     }
     view.setModel (model);
 }
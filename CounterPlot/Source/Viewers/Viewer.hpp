@@ -3,6 +3,7 @@
 #include "../Components/VariantTree.hpp"
 #include "../Components/TableView.hpp"
 #include "../Core/Runtime.hpp"
+#include "../Core/AsciiLoader.hpp"
 
 
 
@@ -107,6 +108,13 @@ public:
      */
     virtual const Runtime::Kernel* getKernel() const { return nullptr; }
 
+    /**
+     * Viewers may return a set of named figures describing their internal
+     * resource usage (e.g. bytes copied, cache sizes). These are shown below
+     * the kernel rules in the environment view.
+     */
+    virtual StringPairArray getStatistics() const { return {}; }
+
     virtual bool canReceiveMessages() const { return false; }
 
     virtual bool receiveMessage (const String& message) { return true; }
@@ -190,6 +198,7 @@ private:
     File currentFile;
     TableModel model;
     TableView view;
+    std::unique_ptr<AsciiLoader> loader;
 };
 
 